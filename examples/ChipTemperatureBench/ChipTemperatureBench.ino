@@ -0,0 +1,186 @@
+// ChipTemperatureBench - CPU cycles taken by the ChipTemperature code paths
+// Timer1 runs at clk/1, so TCNT1 counts the CPU cycles directly
+// The results are printed to Serial at 115200, compare them between the library versions
+// Each path is run several times, and the minimum is printed,
+//  with the cost of reading TCNT1 itself subtracted
+// ATmega32U4 and ATmega328P only, ATtiny85 has neither 16-bit Timer1 nor Serial
+// Timer1 is taken over by the sketch, so the PWM on its pins does not work
+
+#include <ChipTemperature.h>
+
+#if defined(__AVR_ATtiny85__)
+#error ChipTemperatureBench needs 16-bit Timer1 and Serial
+#endif
+
+// Repeats of each measurement
+#define BENCH_REPEATS  8
+
+// Sinks for the results, so the compiler does not throw the measured code away
+volatile uint16_t sink16;
+volatile int32_t sink32;
+volatile bool sinkBool;
+// Input for the conversions, so the compiler does not fold them at compile time
+volatile int32_t inputKQ16 = (int32_t)300 << 16;
+volatile uint16_t inputSample = 350 << CHIPTEMP_RAW_FRAC_BITS;
+
+// Cost of the empty measurement, subtracted from all others
+uint16_t benchOverhead = 0;
+
+// Runs prepare (not measured) and then statement (measured) BENCH_REPEATS times,
+//  and prints the minimum cycles of statement
+// The interrupts are disabled only for the time of statement
+#define BENCH(name, prepare, statement)                         \
+  do {                                                          \
+    uint16_t best = 0xFFFF;                                     \
+    for (uint8_t i = 0; i < BENCH_REPEATS; ++i) {               \
+      prepare;                                                  \
+      noInterrupts();                                           \
+      uint16_t start = TCNT1;                                   \
+      statement;                                                \
+      uint16_t cycles = TCNT1 - start;                          \
+      interrupts();                                             \
+      if (cycles < best) {                                      \
+        best = cycles;                                          \
+      }                                                         \
+    }                                                           \
+    benchReport(F(name), best);                                 \
+  } while (0)
+
+void benchReport(const __FlashStringHelper* name, uint16_t cycles) {
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(cycles - benchOverhead);
+  Serial.println(F(" cycles"));
+}
+
+// The objects under the test
+// Calibrated, so getK() does the real calibration math
+ChipTemperature temp(ChipTempCalPointC(-40, 269), ChipTempCalPointC(85, 432));
+ChipTemperatureT<64> temp64;
+// 4-segment calibration table, for the cost of the segment search
+const ChipTempCalSegment calTable[] PROGMEM = {
+  ChipTempCalSegment(ChipTempCalPointC(-40, 269), ChipTempCalPointC(0, 318)),
+  ChipTempCalSegment(ChipTempCalPointC(0, 318), ChipTempCalPointC(25, 350)),
+  ChipTempCalSegment(ChipTempCalPointC(25, 350), ChipTempCalPointC(60, 395)),
+  ChipTempCalSegment(ChipTempCalPointC(60, 395), ChipTempCalPointC(85, 432))
+};
+ChipTemperature tempTable(calTable, sizeof(calTable) / sizeof(calTable[0]));
+// Same calibration, but through the RAM lookup table of -40..85C
+ChipTemperature tempLut(calTable, sizeof(calTable) / sizeof(calTable[0]));
+uint16_t lut[432 - 269 + 1];
+ChipTemperatureT<CHIPTEMP_SAMPLES_FOR_AVG, ChipTempFilterEmaT<3> > tempEma;
+ChipTemperatureT<CHIPTEMP_SAMPLES_FOR_AVG, ChipTempFilterMedianT<5> > tempMedian;
+ChipTemperature tempScheduled;
+// Calibrated, with the alarm limits of 0 and 70C
+ChipTemperature tempAlarmed(ChipTempCalPointC(-40, 269), ChipTempCalPointC(85, 432));
+ChipTempAlarm alarm;
+// Corrected by the bandgap, on ATmega32U4 only, the same as temp on the others
+// The bandgap reading is once per CHIPTEMP_BANDGAP_INTERVAL samples,
+//  so the minimum of the repeats is the scaling alone
+ChipTemperature tempCorrected;
+// The filter stages alone
+ChipTempFilterEmaT<3> ema;
+ChipTempFilterMedianT<5> median;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial);
+  // Normal mode, clk/1, no compare outputs
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCCR1C = 0;
+  // Fill the objects, so the getters run on the real data
+  temp.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+  temp64.acquireBurst(64);
+  tempTable.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+  tempLut.buildLut(lut, 269, sizeof(lut) / sizeof(lut[0]));
+  tempLut.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+  tempEma.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+  tempMedian.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+  tempScheduled.setSamplePeriod(1000000UL);
+  tempScheduled.loop();
+  alarm.setLimits(tempAlarmed, (int32_t)celsiusToKelvin(0) << CHIPTEMP_CAL_SHIFT,
+                    (int32_t)celsiusToKelvin(70) << CHIPTEMP_CAL_SHIFT,
+                    (int32_t)2 << CHIPTEMP_CAL_SHIFT);
+  tempAlarmed.setAlarm(&alarm);
+  tempAlarmed.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+  tempCorrected.setBandgapCorrection(CHIPTEMP_BANDGAP_NOMINAL << CHIPTEMP_RAW_FRAC_BITS);
+  tempCorrected.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+
+  Serial.println(F("ChipTemperatureBench, CPU cycles"));
+  BENCH("TCNT1 overhead, not subtracted", , );
+  {
+    // Measure the overhead once again, now to subtract it
+    uint16_t best = 0xFFFF;
+    for (uint8_t i = 0; i < BENCH_REPEATS; ++i) {
+      noInterrupts();
+      uint16_t start = TCNT1;
+      uint16_t cycles = TCNT1 - start;
+      interrupts();
+      if (cycles < best) {
+        best = cycles;
+      }
+    }
+    benchOverhead = best;
+  }
+
+  // Hardware readers
+  BENCH("blocking read, sensor reselected", chipTemperatureReleaseMux(),
+          sink16 = chipTemperatureReadRaw_AVR());
+  BENCH("blocking read, sensor kept", ,
+          sink16 = chipTemperatureReadRaw_AVR());
+#ifdef CHIPTEMP_USE_ADC_ISR
+  // The async reads need the library ADC_vect handler, see CHIPTEMP_USE_ADC_ISR
+  uint16_t reading;
+  BENCH("async read, start", ,
+          sinkBool = chipTemperatureReadRawAsync_AVR(reading, true));
+  BENCH("async read, collect and restart", delay(1),
+          sinkBool = chipTemperatureReadRawAsync_AVR(reading, true));
+  // Let the last async reading complete, and collect it
+  delay(1);
+  chipTemperatureReadRawAsync_AVR(reading, true);
+  delay(1);
+  chipTemperatureReadRawAsync_AVR(reading, true);
+#endif
+
+  // loop() of the whole object, the reading included
+  BENCH("loop(), N=4", , temp.loop());
+  BENCH("loop(), N=64", , temp64.loop());
+  BENCH("loop(), N=4, EMA", , tempEma.loop());
+  BENCH("loop(), N=4, median of 5", , tempMedian.loop());
+  BENCH("loop(), no sample due", , tempScheduled.loop());
+  BENCH("loop(), N=4, alarm", , tempAlarmed.loop());
+  BENCH("loop(), N=4, bandgap corrected", , tempCorrected.loop());
+
+  // Filter stages alone
+  BENCH("EMA stage", , sink16 = ema.apply(inputSample));
+  BENCH("median of 5 stage", , sink16 = median.apply(inputSample));
+
+  // Averaging and calibration
+  // The calibration of the unchanged average is cached, so only the first of the repeats
+  //  pays it, and the minimum of getKQ16() and getK() is the cost of the cache hit,
+  //  the same for any calibration, while calibrate() is the calibration itself
+  BENCH("getRaw()", , sink16 = temp.getRaw());
+  BENCH("getRawQ6()", , sink16 = temp.getRawQ6());
+  BENCH("hasChanged()", , sinkBool = temp.hasChanged());
+  BENCH("getKQ16(), cached", , sink32 = temp.getKQ16());
+  BENCH("getK(), cached", , sink16 = temp.getK());
+  BENCH("calibrate()", , sink32 = temp.calibrate(inputSample));
+  BENCH("calibrate(), 4-segment table", , sink32 = tempTable.calibrate(inputSample));
+  BENCH("calibrate(), lookup table", , sink32 = tempLut.calibrate(inputSample));
+  BENCH("getSlopeKQ16(), N=64", , sink32 = temp64.getSlopeKQ16());
+
+  // Unit conversions, on the same Q16.16 input
+  BENCH("getCentiK()", , sink32 = temp.getCentiK());
+  BENCH("getMilliC()", , sink32 = temp.getMilliC());
+  BENCH("getMilliF()", , sink32 = temp.getMilliF());
+  BENCH("kelvinQ16ToCentiKelvin()", , sink32 = kelvinQ16ToCentiKelvin(inputKQ16));
+  BENCH("kelvinQ16ToMilliCelsius()", , sink32 = kelvinQ16ToMilliCelsius(inputKQ16));
+  BENCH("kelvinQ16ToMilliFahrenheit()", , sink32 = kelvinQ16ToMilliFahrenheit(inputKQ16));
+  BENCH("kelvinToCelsius()", , sink16 = kelvinToCelsius((uint16_t)(inputKQ16 >> 16)));
+  BENCH("celsiusToFahrenheit()", , sink16 = celsiusToFahrenheit((int16_t)(inputKQ16 >> 16)));
+  Serial.println(F("Done"));
+}
+
+void loop() {
+}
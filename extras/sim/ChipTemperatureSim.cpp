@@ -0,0 +1,360 @@
+// ChipTemperatureSim - the library on the desktop, with the simulated hardware
+// Runs the averaging, the filters, the calibration and the conversions on millions of
+//  simulated samples, and prints the results and the host time per loop()
+// Build and run from the library root:
+//  g++ -std=gnu++11 -O2 -DCHIPTEMP_HW_SIM -Isrc src/*.cpp extras/sim/ChipTemperatureSim.cpp -o sim
+//  ./sim
+// ./sim lut prints the lookup table of the calibration table below for useLut(),
+//  as the PROGMEM array source
+// The results are checked against the expected ones with tolerances,
+//  each failure is printed, and the exit code is 1 if any, so a CI run catches them
+// The AVR-only sources compile to nothing with CHIPTEMP_HW_SIM
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "ChipTemperature.h"
+
+// Iterations of each run
+#define SIM_LOOPS  4000000UL
+
+// A recorded-like trace: the slow heating with the 1..2 noise of the hardware
+static const uint16_t simTrace[] = {
+  350, 351, 349, 350, 352, 351, 350, 351,
+  352, 351, 353, 352, 351, 352, 354, 353
+};
+
+// The multi-point calibration, bending at the extremes
+static const ChipTempCalSegment simCalTable[] PROGMEM = {
+  ChipTempCalSegment(ChipTempCalPointC(-40, 269), ChipTempCalPointC(0, 318)),
+  ChipTempCalSegment(ChipTempCalPointC(0, 318), ChipTempCalPointC(25, 350)),
+  ChipTempCalSegment(ChipTempCalPointC(25, 350), ChipTempCalPointC(60, 395)),
+  ChipTempCalSegment(ChipTempCalPointC(60, 395), ChipTempCalPointC(85, 432))
+};
+
+// Counts the state changes of the alarm run below
+static unsigned long simAlarmChanges[3];
+
+static void simOnAlarm(ChipTempAlarm& alarm, ChipTempAlarmState state)
+{
+  (void)alarm;
+  ++simAlarmChanges[state];
+}
+
+// Number of the failed checks, see simExpect()
+static unsigned simFailures;
+
+// Checks the result to be within expected  tolerance, prints and counts the failure if not
+static void simExpect(const char* what, double value, double expected, double tolerance)
+{
+  if ((value < expected - tolerance) || (value > expected + tolerance)) {
+    printf("FAILED: %s is %g, expected %g  %g\n", what, value, expected, tolerance);
+    ++simFailures;
+  }
+}
+
+// Runs SIM_LOOPS loop() calls, and prints the results and the time
+// Returns the number of hasChanged() loops
+template <class T>
+static unsigned long simRun(const char* name, T& temp)
+{
+  uint32_t readings = chipTemperatureSimReadingCount();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  uint32_t check = 0;
+  unsigned long changes = 0;
+  for (unsigned long i = 0; i < SIM_LOOPS; ++i) {
+    chipTemperatureSimAdvanceMicros(100);
+    temp.loop();
+    if (temp.hasChanged()) {
+      ++changes;
+    }
+    check += (uint32_t)temp.getKQ16();
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count() / SIM_LOOPS;
+  printf("%-24s raw %u rawQ6 %u K %u mC %ld mF %ld, %lu readings, %lu changes, %.1f ns/loop (%lu)\n",
+          name, temp.getRaw(), temp.getRawQ6(), temp.getK(),
+          (long)temp.getMilliC(), (long)temp.getMilliF(),
+          (unsigned long)(chipTemperatureSimReadingCount() - readings), changes, ns,
+          (unsigned long)check);
+  return changes;
+}
+
+// The range of the lookup table, -40..85C
+#define SIM_LUT_FIRST  269
+#define SIM_LUT_COUNT  (432 - 269 + 1)
+
+// Prints the lookup table for useLut()
+static void simPrintLut(const uint16_t* lut)
+{
+  printf("// Q10.6 Kelvins for the hardware readings from %u, see ChipTempCalibration::useLut()\n",
+          SIM_LUT_FIRST);
+  printf("const uint16_t chipTempLut[%u] PROGMEM = {", SIM_LUT_COUNT);
+  for (unsigned i = 0; i < SIM_LUT_COUNT; ++i) {
+    printf("%s%s%u", (i == 0) ? "" : ",", ((i % 8) == 0) ? "\n  " : " ", lut[i]);
+  }
+  printf("\n};\n");
+}
+
+int main(int argc, char** argv)
+{
+  // Calibrated, 269 reads at -40C, 432 at 85C
+  ChipTemperature temp(ChipTempCalPointC(-40, 269), ChipTempCalPointC(85, 432));
+  ChipTemperatureT<64> temp64;
+  ChipTemperature tempTable(simCalTable, sizeof(simCalTable) / sizeof(simCalTable[0]));
+  ChipTemperature tempLut(simCalTable, sizeof(simCalTable) / sizeof(simCalTable[0]));
+  static uint16_t lut[SIM_LUT_COUNT];
+  tempLut.buildLut(lut, SIM_LUT_FIRST, SIM_LUT_COUNT);
+  if ((argc > 1) && (strcmp(argv[1], "lut") == 0)) {
+    simPrintLut(lut);
+    return 0;
+  }
+  ChipTemperatureT<1, ChipTempFilterEmaT<4> > tempEma;
+  ChipTemperatureT<4, ChipTempFilterMedianT<5> > tempMedian;
+  ChipTemperature tempOversampled;
+  tempOversampled.setOversampling(2);
+  ChipTemperature tempAsync;
+  tempAsync.setMode(CHIPTEMP_MODE_ASYNC);
+  ChipTemperature tempScheduled;
+  tempScheduled.setSamplePeriod(10000);
+
+  // 350 is 22.1C (295K) by the 2 points of temp, and 25C (298K) by the table
+  chipTemperatureSimSetNoise(350, 2, 1);
+  simRun("noise, calibrated N=4", temp);
+  simExpect("calibrated N=4 K", temp.getK(), 295, 1);
+  // The whole LSB changes of the average of 64 are rare, see hasChanged()
+  simExpect("N=64 changes", simRun("noise, N=64", temp64), 0, SIM_LOOPS / 100);
+  simExpect("N=64 raw", temp64.getRaw(), 350, 1);
+  simRun("noise, calibration table", tempTable);
+  simExpect("calibration table K", tempTable.getK(), 298, 1);
+  simRun("noise, lookup table", tempLut);
+  simExpect("lookup table K", tempLut.getK(), 298, 1);
+  simExpect("lookup table mC", tempLut.getMilliC(), tempTable.getMilliC(), 1000);
+  simRun("noise, EMA", tempEma);
+  simExpect("EMA raw", tempEma.getRaw(), 350, 1);
+  simRun("noise, median of 5", tempMedian);
+  simExpect("median raw", tempMedian.getRaw(), 350, 1);
+  simRun("noise, oversampled by 16", tempOversampled);
+  simExpect("oversampled raw", tempOversampled.getRaw(), 350, 1);
+  simRun("noise, async", tempAsync);
+  simExpect("async raw", tempAsync.getRaw(), 350, 1);
+  simExpect("async getK() == getRaw()", tempAsync.getK(), tempAsync.getRaw(), 0);
+  uint32_t readings = chipTemperatureSimReadingCount();
+  simRun("noise, period 10ms", tempScheduled);
+  // 400s of the simulated time
+  simExpect("period 10ms readings", chipTemperatureSimReadingCount() - readings,
+              SIM_LOOPS / 100, 1);
+
+  // Two consumers of the single acquisition stream, same number of readings as one
+  ChipTempViewT<64> view64;
+  ChipTempViewT<1, ChipTempFilterEmaT<4> > viewEma(ChipTempCalPointC(-40, 269),
+                                                      ChipTempCalPointC(85, 432));
+  ChipTempSampler& sampler = ChipTempSampler::instance();
+  sampler.subscribe(view64);
+  sampler.subscribe(viewEma);
+  readings = chipTemperatureSimReadingCount();
+  for (unsigned long i = 0; i < SIM_LOOPS; ++i) {
+    sampler.loop();
+  }
+  printf("%-24s raw %u K %u, EMA raw %u K %u, %lu readings\n", "sampler, 2 views",
+          view64.getRaw(), view64.getK(), viewEma.getRaw(), viewEma.getK(),
+          (unsigned long)(chipTemperatureSimReadingCount() - readings));
+  simExpect("sampler readings", chipTemperatureSimReadingCount() - readings, SIM_LOOPS, 0);
+  simExpect("sampler N=64 raw", view64.getRaw(), 350, 1);
+  simExpect("sampler EMA K", viewEma.getK(), 295, 1);
+
+  sampler.unsubscribe(view64);
+  sampler.unsubscribe(viewEma);
+
+  // The stream of the history, drained in batches as a logger would,
+  //  decoded back, and compared to the samples as they were taken
+  static uint8_t streamBuffer[256];
+  ChipTempStream stream(streamBuffer, sizeof(streamBuffer));
+  ChipTemperatureT<1> tempStreamed;
+  tempStreamed.setSamplePeriod(1000);
+  tempStreamed.setStream(&stream);
+  static uint16_t expectedRaw[256];
+  static uint32_t expectedTime[256];
+  uint8_t expectedHead = 0, expectedTail = 0;
+  uint16_t decodedRaw = 0;
+  uint32_t decodedTime = 0;
+  unsigned long bytes = 0, records = 0, mismatches = 0;
+  for (unsigned long i = 0; i < SIM_LOOPS / 10; ++i) {
+    chipTemperatureSimAdvanceMicros(100);
+    uint32_t readings = chipTemperatureSimReadingCount();
+    tempStreamed.loop();
+    if (chipTemperatureSimReadingCount() != readings) {
+      expectedRaw[expectedHead] = tempStreamed.getRawQ6();
+      expectedTime[expectedHead++] = micros();
+    }
+    if ((i % 500) != 499) {
+      continue;
+    }
+    // Every 50ms, alternately one by one, or in batches decoded here
+    uint16_t rawQ6;
+    uint32_t timeUs;
+    uint8_t batch[64];
+    uint16_t length;
+    if ((i % 1000) == 499) {
+      // The decoder below continues from the last sample read here
+      while (stream.read(rawQ6, timeUs)) {
+        decodedRaw = rawQ6;
+        decodedTime = timeUs;
+        ++records;
+        mismatches += ((rawQ6 != expectedRaw[expectedTail])
+                        || (timeUs - expectedTime[expectedTail++] + 32 > 64)) ? 1 : 0;
+      }
+    } else while ((length = stream.drain(batch, sizeof(batch))) != 0) {
+      bytes += length;
+      for (uint16_t at = 0; at < length; ++records) {
+        if (batch[at] == CHIPTEMP_STREAM_FULL) {
+          decodedRaw = (uint16_t)(batch[at + 1] | (batch[at + 2] << 8));
+          decodedTime = (uint32_t)batch[at + 3] | ((uint32_t)batch[at + 4] << 8)
+                          | ((uint32_t)batch[at + 5] << 16) | ((uint32_t)batch[at + 6] << 24);
+          at += 7;
+        } else {
+          decodedRaw = (uint16_t)(decodedRaw + ((uint16_t)(int8_t)batch[at] << (2 * (batch[at + 2] >> 6))));
+          decodedTime += (uint32_t)(batch[at + 1] | ((batch[at + 2] & 0x3F) << 8))
+                           << CHIPTEMP_STREAM_TIME_SHIFT;
+          at += 3;
+        }
+        mismatches += ((decodedRaw != expectedRaw[expectedTail])
+                        || (decodedTime - expectedTime[expectedTail++] + 32 > 64)) ? 1 : 0;
+      }
+    }
+  }
+  printf("%-24s %lu records, %lu bytes drained, %lu mismatched, %u dropped\n",
+          "stream, period 1ms", records, bytes, mismatches, stream.droppedCount());
+  // One record per 1ms sample, over 40s
+  simExpect("stream records", records, SIM_LOOPS / 100, 1);
+  simExpect("stream mismatches", mismatches, 0, 0);
+  simExpect("stream dropped", stream.droppedCount(), 0, 0);
+
+  // The alarm on the slow heating and cooling of 344..362K, 2 noise, averaged by 64,
+  //  with the limits of 348 and 358K and the hysteresis of 1K
+  // 1 entry of each alarm per cycle is the limits working,
+  //  more would be the noise getting through the hysteresis
+  ChipTempAlarm alarm;
+  alarm.setLimits(temp64, (int32_t)348 << CHIPTEMP_CAL_SHIFT, (int32_t)358 << CHIPTEMP_CAL_SHIFT,
+                    (int32_t)1 << CHIPTEMP_CAL_SHIFT);
+  alarm.setCallback(simOnAlarm);
+  temp64.setAlarm(&alarm);
+  for (unsigned long i = 0; i < SIM_LOOPS / 10; ++i) {
+    // 1000 loops per step, up and down
+    if ((i % 1000) == 0) {
+      uint16_t step = (uint16_t)((i / 1000) % 36);
+      chipTemperatureSimSetNoise((uint16_t)((step < 18) ? 344 + step : 380 - step), 2, 1 + i);
+    }
+    temp64.loop();
+  }
+  temp64.setAlarm(NULL);
+  printf("%-24s %lu high, %lu low, %lu normal, %lu cycles\n", "alarm, 348..358K",
+          simAlarmChanges[CHIPTEMP_ALARM_HIGH], simAlarmChanges[CHIPTEMP_ALARM_LOW],
+          simAlarmChanges[CHIPTEMP_ALARM_NORMAL], SIM_LOOPS / 10 / 36000);
+  // The partial last cycle may enter one more alarm
+  simExpect("alarm high entries", simAlarmChanges[CHIPTEMP_ALARM_HIGH],
+              SIM_LOOPS / 10 / 36000 + 0.5, 0.5);
+  simExpect("alarm low entries", simAlarmChanges[CHIPTEMP_ALARM_LOW],
+              SIM_LOOPS / 10 / 36000 + 0.5, 0.5);
+
+  // The slope on the heating by 1 LSB per 100ms, 2 noise, sampled each 10ms:
+  //  10K/s uncalibrated, 7.67K/s by the calibration of temp, 1.304 LSB per K
+  // The window of 64 samples is 640ms, so the noise gives ~1K/s of error,
+  //  and the mean of the readings over 20s is printed
+  ChipTemperatureT<64> tempRising;
+  ChipTemperatureT<64> tempRisingCalibrated(ChipTempCalPointC(-40, 269),
+                                              ChipTempCalPointC(85, 432));
+  tempRising.setSamplePeriod(10000);
+  tempRisingCalibrated.setSamplePeriod(10000);
+  double slope = 0, slopeCalibrated = 0;
+  unsigned long slopes = 0;
+  for (unsigned long i = 0; i < 300000; ++i) {
+    if ((i % 1000) == 0) {
+      chipTemperatureSimSetNoise((uint16_t)(300 + i / 1000), 2, 1 + i);
+    }
+    chipTemperatureSimAdvanceMicros(100);
+    tempRising.loop();
+    tempRisingCalibrated.loop();
+    if ((i >= 100000) && ((i % 100) == 0)) {
+      slope += tempRising.getSlopeKQ16() / 65536.0;
+      slopeCalibrated += tempRisingCalibrated.getSlopeKQ16() / 65536.0;
+      ++slopes;
+    }
+  }
+  printf("%-24s %.3f K/s, calibrated %.3f K/s\n", "slope, 10 LSB/s",
+          slope / slopes, slopeCalibrated / slopes);
+  simExpect("slope K/s", slope / slopes, 10, 0.3);
+  simExpect("calibrated slope K/s", slopeCalibrated / slopes, 10 * 125.0 / 163, 0.3);
+
+  // The reference 2.3% low, so the bandgap reads 450 and not 440,
+  //  and the sensor 358 and not 350, till corrected by the bandgap
+  ChipTemperatureT<64> tempDrifted;
+  ChipTemperatureT<64> tempCorrected;
+  tempCorrected.setBandgapCorrection(CHIPTEMP_BANDGAP_NOMINAL << CHIPTEMP_RAW_FRAC_BITS);
+  // The bandgap readings interleaved with the async ones
+  ChipTemperatureT<64> tempCorrectedAsync;
+  tempCorrectedAsync.setMode(CHIPTEMP_MODE_ASYNC);
+  tempCorrectedAsync.setBandgapCorrection(CHIPTEMP_BANDGAP_NOMINAL << CHIPTEMP_RAW_FRAC_BITS);
+  chipTemperatureSimSetNoise(350, 2, 1);
+  chipTemperatureSimSetBandgap(450);
+  simRun("drift, uncorrected", tempDrifted);
+  simExpect("drift uncorrected raw", tempDrifted.getRaw(), 358, 1);
+  simRun("drift, bandgap corrected", tempCorrected);
+  simExpect("drift corrected raw", tempCorrected.getRaw(), 350, 1);
+  simExpect("drift bandgap", tempCorrected.getBandgapQ6() >> CHIPTEMP_RAW_FRAC_BITS, 450, 1);
+  simRun("drift, corrected async", tempCorrectedAsync);
+  simExpect("drift corrected async raw", tempCorrectedAsync.getRaw(), 350, 1);
+  chipTemperatureSimSetBandgap(CHIPTEMP_BANDGAP_NOMINAL);
+
+  // The calibration set at runtime, saved with the average, and loaded by a new object
+  //  as after a reset: valid at once, with no samples
+  ChipTempStore store(0, 4);
+  ChipTemperature tempSaved;
+  chipTemperatureSimSetNoise(350, 2, 1);
+  tempSaved.setCalibration(ChipTempCalPointC(-40, 269), ChipTempCalPointC(85, 432));
+  tempSaved.acquireBurst(CHIPTEMP_SAMPLES_FOR_AVG);
+  // 10 saves wrap the ring of 4 slots
+  for (uint8_t i = 0; i < 10; ++i) {
+    tempSaved.saveState(store);
+  }
+  ChipTempStore storeAfterReset(0, 4);
+  ChipTemperature tempLoaded;
+  bool loaded = tempLoaded.loadState(storeAfterReset);
+  printf("%-24s loaded %d, valid %d, K %u of %u, mC %ld of %ld\n", "EEPROM, warm start",
+          loaded, tempLoaded.isValid(), tempLoaded.getK(), tempSaved.getK(),
+          (long)tempLoaded.getMilliC(), (long)tempSaved.getMilliC());
+  simExpect("EEPROM loaded", loaded, 1, 0);
+  simExpect("EEPROM valid", tempLoaded.isValid(), 1, 0);
+  simExpect("EEPROM mC", tempLoaded.getMilliC(), tempSaved.getMilliC(), 0);
+  // The latest slot (the 10th save, slot 1) damaged, as by the power loss while writing it
+  // The 9th save is loaded, and the next save goes after it, overwriting the damaged one
+  chipTemperatureSimEeprom()[1 * CHIPTEMP_STORE_SLOT_SIZE + 5] ^= 0x01;
+  ChipTempStore storeDamaged(0, 4);
+  ChipTempStoredState state;
+  loaded = storeDamaged.load(state);
+  storeDamaged.save(state);
+  const uint8_t* eeprom = chipTemperatureSimEeprom();
+  printf("%-24s loaded %d, sequence numbers %u %u %u %u\n", "EEPROM, damaged slot", loaded,
+          eeprom[0], eeprom[CHIPTEMP_STORE_SLOT_SIZE],
+          eeprom[2 * CHIPTEMP_STORE_SLOT_SIZE], eeprom[3 * CHIPTEMP_STORE_SLOT_SIZE]);
+  // The saves have the sequence numbers 0..9, in the slots 0, 1, 2, 3, 0, ...
+  // 9 in slot 1 is damaged, so 8 is loaded, and the next save rewrites slot 1 as 9
+  simExpect("EEPROM damaged loaded", loaded, 1, 0);
+  simExpect("EEPROM slot 0 sequence", eeprom[0], 8, 0);
+  simExpect("EEPROM slot 1 sequence", eeprom[CHIPTEMP_STORE_SLOT_SIZE], 9, 0);
+  simExpect("EEPROM slot 2 sequence", eeprom[2 * CHIPTEMP_STORE_SLOT_SIZE], 6, 0);
+  simExpect("EEPROM slot 3 sequence", eeprom[3 * CHIPTEMP_STORE_SLOT_SIZE], 7, 0);
+
+  chipTemperatureSimSetTrace(simTrace, sizeof(simTrace) / sizeof(simTrace[0]));
+  // The window of 64 is exactly 4 traces, so its average is the trace one, 351.375
+  simRun("trace, N=64", temp64);
+  simExpect("trace N=64 rawQ6", temp64.getRawQ6(), 351.375 * 64, 0);
+  simRun("trace, EMA", tempEma);
+  simExpect("trace EMA rawQ6", tempEma.getRawQ6(), 351.375 * 64, 64);
+  if (simFailures != 0) {
+    printf("%u checks FAILED\n", simFailures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
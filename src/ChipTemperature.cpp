@@ -1,112 +1,582 @@
-// Reads the on-chip temperature sensor as abstract [0..1023] integer
-// The reading is linear, and must be then calibrated to the real temperature
-// As the undocumented "as is" empirical fact, one can treat the value
-//  as Kelvin degrees from absolute zero (-273 C),
-//  though uncalibrated value can give the error by 10C
-// The reading is frequently oscillating by +-1..2
-// Applying the debounce tineout logic (like for buttons,
-//   i.e. wait till the reading is constant for some time)
-//  does not work - the debounce timeout never occurs
-// So, some averaging should be used on the return value of this function
-// The logic is based on analogRead() source, and does not break analogRead()
-// The function only contains delayMicroseconds(2), not delay() or analogs of any kind,
-//  so it supports hard realtime
-int chipTemperatureReadRaw()
+// ChipTemperature - the implementation not dependent on the averaging window:
+//  ChipTempAcquisition, ChipTempCalibration and ChipTempSampler
+// ChipTemperatureT<N> itself is a template, and is implemented in ChipTemperature.h
+
+#ifndef CHIPTEMP_HW_SIM
+#include <Arduino.h>
+#endif
+#include "ChipTemperature.h"
+
+bool ChipTempAcquisition::setMode(ChipTempMode mode) {
+#if !defined(CHIPTEMP_USE_ADC_ISR) && !defined(CHIPTEMP_HW_SIM)
+  // No ADC_vect handler to complete the background readings, or to wake up the sleep
+  if (mode != CHIPTEMP_MODE_BLOCKING) {
+    return false;
+  }
+#endif
+  if (_isAuto(_mode)) {
+    _stopHwAuto();
+  }
+  _mode = mode;
+  if (_isAuto(_mode)) {
+    // No bandgap readings in these modes, see setBandgapCorrection()
+    _bgReferenceQ6 = 0;
+    _startHwAuto(_mode);
+  }
+  return true;
+}
+
+void ChipTempAcquisition::setSpeed(ChipTempSpeed speed) {
+  _setHwSpeed(speed);
+}
+
+void ChipTempAcquisition::setSamplePeriod(uint32_t periodUs) {
+  _periodUs = periodUs;
+}
+
+void ChipTempAcquisition::setOversampling(uint8_t n) {
+  _osShift = (n > CHIPTEMP_OVERSAMPLING_MAX) ? CHIPTEMP_OVERSAMPLING_MAX : n;
+  // Restart the sample being oversampled
+  _osSum = 0;
+  _osCount = 0;
+}
+
+bool ChipTempAcquisition::setBandgapCorrection(uint16_t referenceQ6) {
+  if (!chipTemperatureHasBandgap_AVR() || _isAuto(_mode)) {
+    return false;
+  }
+  _bgReferenceQ6 = referenceQ6;
+  // The first sample measures the bandgap, and starts the average from it
+  _bgQ6 = 0;
+  _bgScale = 1 << 14;
+  _bgCountdown = 0;
+  return true;
+}
+
+uint16_t ChipTempAcquisition::getBandgapQ6() const {
+  return _bgQ6;
+}
+
+bool ChipTempAcquisition::_acquire(uint16_t& sample) {
+  uint16_t reading;
+  bool done = false;
+  if (_mode == CHIPTEMP_MODE_ASYNC) {
+    if ((_bgReferenceQ6 != 0) && (_bgCountdown == 0) && (_osCount == 0)) {
+      // The bandgap reading goes before the sample, same as in the blocking modes
+      if (chipTemperatureReadBandgapAsync_AVR(reading)) {
+        _addBandgap(reading);
+      }
+    } else {
+      // Only collects the finished readings, never waits for the ADC
+      // With a sample period, the last reading of the sample does not start the next one,
+      //  or its result would wait in the ADC for the whole period
+      // The next sample starts it, once _isDue()
+      bool restart = (_periodUs == 0) || ((uint8_t)(_osCount + 1) < (uint8_t)(1 << (2 * _osShift)));
+      done = _readHwAsync(reading, restart) && _addReading(reading, sample);
+    }
+  } else if (_isAuto(_mode)) {
+    // All readings done by the timer since the last call, till the sample is complete
+    while (!done && _readHwAuto(reading)) {
+      done = _addReading(reading, sample);
+    }
+  } else {
+    if ((_bgReferenceQ6 != 0) && (_bgCountdown == 0)) {
+      _addBandgap(chipTemperatureReadBandgap_AVR());
+    }
+    // The whole oversampled sample at once
+    while (!done) {
+      done = _addReading((_mode == CHIPTEMP_MODE_SLEEP) ? _readHwSleep() : _readHw(), sample);
+    }
+  }
+  if (done) {
+    // The next sample waits for the sample period
+    _sampling = false;
+    if (_bgCountdown != 0) {
+      --_bgCountdown;
+    }
+  }
+  return done;
+}
+
+bool ChipTempAcquisition::_addReading(uint16_t reading, uint16_t& sample) {
+  _osSum += reading;
+  if (++_osCount < (uint8_t)(1 << (2 * _osShift))) {
+    return false;
+  }
+  // The decimation: the sum of 4^n readings shifted right by n is the (10+n)-bit sample,
+  //  and it is then shifted left by 6-n to Q10.6
+  // Both shifts are combined to one, which loses no bits
+  sample = _osSum << (CHIPTEMP_RAW_FRAC_BITS - 2 * _osShift);
+  _osSum = 0;
+  _osCount = 0;
+  if (_bgReferenceQ6 != 0) {
+    // Rounded, and clamped to the Q10.6 range
+    uint32_t scaled = ((uint32_t)sample * _bgScale + (1 << 13)) >> 14;
+    sample = (scaled > 0xFFFF) ? 0xFFFF : (uint16_t)scaled;
+  }
+  return true;
+}
+
+void ChipTempAcquisition::_addBandgap(uint16_t reading) {
+  _bgCountdown = CHIPTEMP_BANDGAP_INTERVAL;
+  uint16_t readingQ6 = reading << CHIPTEMP_RAW_FRAC_BITS;
+  if (readingQ6 == 0) {
+    return;
+  }
+  // The single reading is 1 LSB, so the average of ~8 of them, same EMA as ChipTempFilterEmaT,
+  //  with the step rounded to nearest
+  _bgQ6 = (_bgQ6 == 0) ? readingQ6
+            : (uint16_t)((int32_t)_bgQ6 + ((((int32_t)readingQ6 - (int32_t)_bgQ6) + 4) >> 3));
+  uint32_t scale = (((uint32_t)_bgReferenceQ6 << 14) + (_bgQ6 >> 1)) / _bgQ6;
+  _bgScale = (scale > 0xFFFF) ? 0xFFFF : (uint16_t)scale;
+}
+
+void ChipTempCalibration::buildLut(uint16_t* lut, uint16_t firstRaw, uint16_t count) {
+  for (uint16_t i = 0; i < count; ++i) {
+    // Q16.16 to Q10.6 Kelvins, rounded, clamped to the uint16_t range
+    int32_t kelvinQ16 = _calibrateLine((uint16_t)((firstRaw + i) << CHIPTEMP_RAW_FRAC_BITS));
+    int32_t kelvinQ6 = (kelvinQ16 + ((int32_t)1 << (CHIPTEMP_CAL_SHIFT - CHIPTEMP_RAW_FRAC_BITS - 1)))
+                          >> (CHIPTEMP_CAL_SHIFT - CHIPTEMP_RAW_FRAC_BITS);
+    lut[i] = (kelvinQ6 < 0) ? 0 : ((kelvinQ6 > 0xFFFF) ? 0xFFFF : (uint16_t)kelvinQ6);
+  }
+  _lut = lut;
+  _lutFirst = firstRaw;
+  _lutCount = count;
+  _lutProgmem = false;
+  _invalidateCache();
+}
+
+void ChipTempCalibration::useLut(const uint16_t* lutProgmem, uint16_t firstRaw, uint16_t count) {
+  _lut = lutProgmem;
+  _lutFirst = firstRaw;
+  _lutCount = count;
+  _lutProgmem = true;
+  _invalidateCache();
+}
+
+uint16_t ChipTempCalibration::uncalibrate(int32_t kelvinQ16) const {
+  if (calibrate(0xFFFF) < kelvinQ16) {
+    return 0xFFFF;
+  }
+  // Invariant: the answer is in [lo, hi]
+  uint16_t lo = 0;
+  uint16_t hi = 0xFFFF;
+  while (lo < hi) {
+    uint16_t mid = (uint16_t)(((uint32_t)lo + hi) >> 1);
+    if (calibrate(mid) >= kelvinQ16) {
+      hi = mid;
+    } else {
+      lo = (uint16_t)(mid + 1);
+    }
+  }
+  return lo;
+}
+
+void ChipTempCalibration::setCalibration(const ChipTempCalPointK& calPoint1,
+                                           const ChipTempCalPointK& calPoint2) {
+  int32_t slope = chipTempCalSlope(calPoint1._tempK, calPoint1._hwReading,
+                                    calPoint2._tempK, calPoint2._hwReading);
+  _setLine(slope, chipTempCalOffset(calPoint1._tempK, calPoint1._hwReading, slope));
+}
+
+bool ChipTempCalibration::_getLine(int32_t& slope, int32_t& offset) const {
+  if (_calTable != NULL) {
+    return false;
+  }
+  slope = _calSlope;
+  offset = _calOffset;
+  return true;
+}
+
+void ChipTempCalibration::_setLine(int32_t slope, int32_t offset) {
+  _calSlope = slope;
+  _calOffset = offset;
+  _calTable = NULL;
+  _calCount = 0;
+  // Built by the previous calibration
+  _lut = NULL;
+  _lutCount = 0;
+  _invalidateCache();
+}
+
+int32_t ChipTempCalibration::calibrate(uint16_t rawQ6) const {
+  if ((_lut == NULL) || (_lutCount == 0)) {
+    return _calibrateLine(rawQ6);
+  }
+  // Rounded to the integer reading, then clamped to the table
+  // In 32 bits, the 16-bit add of AVR wraps the readings from 0xFFE0 to 0
+  uint16_t raw = (uint16_t)(((uint32_t)rawQ6 + (1 << (CHIPTEMP_RAW_FRAC_BITS - 1)))
+                              >> CHIPTEMP_RAW_FRAC_BITS);
+  uint16_t i = (raw <= _lutFirst) ? 0 : (uint16_t)(raw - _lutFirst);
+  if (i >= _lutCount) {
+    i = _lutCount - 1;
+  }
+  uint16_t kelvinQ6 = _lutProgmem ? pgm_read_word(&_lut[i]) : _lut[i];
+  return (int32_t)kelvinQ6 << (CHIPTEMP_CAL_SHIFT - CHIPTEMP_RAW_FRAC_BITS);
+}
+
+int32_t ChipTempCalibration::_calibrateCached(uint16_t rawQ6) const {
+  uint8_t seq = _cacheSeq;
+  if ((seq & 1) == 0) {
+    if (_cacheValid && (_cacheRaw == rawQ6)) {
+      int32_t kelvinQ16 = _cacheKQ16;
+      if (seq == _cacheSeq) {
+        return kelvinQ16;
+      }
+    }
+  }
+  int32_t kelvinQ16 = calibrate(rawQ6);
+  if ((seq & 1) == 0) {
+    ++_cacheSeq;
+    _cacheRaw = rawQ6;
+    _cacheKQ16 = kelvinQ16;
+    _cacheValid = true;
+    ++_cacheSeq;
+  }
+  return kelvinQ16;
+}
+
+void ChipTempCalibration::_invalidateCache() {
+  ++_cacheSeq;
+  _cacheValid = false;
+  ++_cacheSeq;
+}
+
+int32_t ChipTempCalibration::_calibrateLine(uint16_t rawQ6) const {
+  int32_t slope = _calSlope;
+  int32_t offset = _calOffset;
+  if (_calTable != NULL) {
+    _lookupSegment(rawQ6, slope, offset);
+  }
+  // The sign is always correct, even if the calibration points went in reverse order
+  // The integer and fraction parts of the reading are multiplied separately,
+  //  so the Q16.16 slope times the Q10.6 reading does not overflow 32 bits
+  return offset
+          + slope * (int32_t)(rawQ6 >> CHIPTEMP_RAW_FRAC_BITS)
+          + ((slope * (int32_t)(rawQ6 & ((1 << CHIPTEMP_RAW_FRAC_BITS) - 1)))
+              >> CHIPTEMP_RAW_FRAC_BITS);
+}
+
+void ChipTempCalibration::_lookupSegment(uint16_t rawQ6, int32_t& slope, int32_t& offset) const {
+  // The last segment starting at or below the reading, or the first one
+  //  if the reading is below the whole table
+  // Invariant: the answer is in [lo, hi)
+  uint8_t lo = 0;
+  uint8_t hi = _calCount;
+  while ((uint8_t)(hi - lo) > 1) {
+    uint8_t mid = (uint8_t)((lo + hi) >> 1);
+    uint16_t start = pgm_read_word(&_calTable[mid]._hwReading);
+    if (rawQ6 >= (uint16_t)(start << CHIPTEMP_RAW_FRAC_BITS)) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  slope = (int32_t)pgm_read_dword(&_calTable[lo]._slope);
+  offset = (int32_t)pgm_read_dword(&_calTable[lo]._offset);
+}
+
+ChipTempAlarm::ChipTempAlarm() :
+  _highOn(0xFFFF),
+  _highOff(0xFFFF),
+  _lowOn(0),
+  _lowOff(0),
+  _callback(NULL),
+  _state(CHIPTEMP_ALARM_NORMAL),
+  _fired(false)
+{
+}
+
+void ChipTempAlarm::setLimits(const ChipTempCalibration& calibration,
+                                int32_t lowKQ16, int32_t highKQ16, int32_t hysteresisKQ16) {
+  // The high state is entered at highKQ16 and above, and left below highKQ16 - hysteresis,
+  //  the low one is entered below lowKQ16, and left at lowKQ16 + hysteresis and above
+  _highOn = calibration.uncalibrate(highKQ16);
+  _highOff = calibration.uncalibrate(highKQ16 - hysteresisKQ16);
+  _lowOn = calibration.uncalibrate(lowKQ16);
+  _lowOff = calibration.uncalibrate(lowKQ16 + hysteresisKQ16);
+  _state = CHIPTEMP_ALARM_NORMAL;
+  _fired = false;
+}
+
+void ChipTempAlarm::setCallback(Callback callback) {
+  _callback = callback;
+}
+
+ChipTempAlarmState ChipTempAlarm::getState() const {
+  return _state;
+}
+
+bool ChipTempAlarm::hasFired() {
+  if (!_fired) {
+    return false;
+  }
+  _fired = false;
+  return true;
+}
+
+void ChipTempAlarm::_enter(ChipTempAlarmState state) {
+  _state = state;
+  _fired = true;
+  if (_callback != NULL) {
+    _callback(*this, state);
+  }
+}
+
+// CRC-8 of ChipTempStore slots, see CHIPTEMP_STORE_SLOT_SIZE
+// Bitwise, the slots are short and rare
+static uint8_t chipTempStoreCrc(const uint8_t* data, uint8_t size) {
+  uint8_t crc = 0xFF;
+  for (uint8_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; ++bit) {
+      crc = ((crc & 0x80) != 0) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+ChipTempStore::ChipTempStore(uint16_t address, uint8_t slots) :
+  _address(address),
+  _slots((slots == 0) ? 1 : ((slots > 127) ? 127 : slots)),
+  _next(0),
+  _seq(0),
+  _scanned(false)
 {
-  //
-  // ATmega32U4 datasheet, the chapter of:
-  //  24.6.1 Sensor Calibration
-  // says:
-  //  The sensor initial tolerance is large (10C), but its characteristic is linear.
-  //
-  // We are compatible with analogRead() since it will reprogram
-  //  all of the registers we're touching
-  //
-  // We read these twice, and don't want the compiler to get rid of the first reading action
-  //  (it is probably important for the chip)
-  volatile uint8_t low, high;
-  //
-  // Connect the temperature sensor as ADC input,
-  //   power the sensor up,
-  //   and set the proper analog reference for it
-  //
-  // The chapter of:
-  //  24.6 Temperature Sensor
-  // says:
-  //  "The internal 2.56V voltage reference must also be selected
-  //   for the ADC voltage reference source in he temperature sensor measurement."
-  // The chapter of:
-  //  24.9.1 ADC Multiplexer Selection Register  ADMUX
-  // says for REFS1:0:
-  //  "1 1 Internal 2.56V Voltage Reference with external capacitor on AREF pin"
-  // - and Leonardo has the capacitor,
-  //   so does Iskra Neo (Russian clone of Leonardo with MUCH improved power supply chips)
-  // Same chapter, the paragraph of:
-  //  Bits 4:0  MUX4:0: Analog Channel Selection Bits
-  // says for MUX5..0:
-  //  100111 Temperature Sensor
-  ADMUX = _BV(REFS1) | _BV(REFS0) | // REFS1..0 is 0b11 -> internal 2.56V voltage for ref
-                                      // ADLAR (left-adjust result) is 0
-            0x07;                     // MUX4..0 is 0b00111
-  // The chapter of:
-  //  24.9.4 ADC Control and Status Register B  ADCSRB
-  // the paragraph of:
-  //  Bit 5  MUX5: Analog Channel Additional Selection Bits
-  // says:
-  //  "This bit make part of MUX5:0 bits of ADRCSRB and ADMUX register,
-  //  that select the combination of analog inputs connected to the ADC
-  //  (including differential amplifier configuration)."
-  // So, set MUX5 to 1 to get 0b100111
-  ADCSRB = ADCSRB | _BV(MUX5);
-  //
-  // Sensor connected, now start the ADC
-  //
-  // The chapter of:
-  //  24.9.2 ADC Control and Status Register A  ADCSRA
-  // the paragraph of:
-  //  Bit 6  ADSC: ADC Start Conversion
-  // says:
-  //  "In Single Conversion mode, write this bit to one to start each conversion.
-  //   In Free Running mode, write this bit to one to start the first conversion.
-  //   The first conversion after ADSC has been written after the ADC has been enabled,
-  //    or if ADSC is written at the same time as the ADC is enabled,
-  //    will take 25 ADC clock cycles instead of the normal 13.
-  //    This first conversion performs initialization of the ADC.
-  //   ADSC will read as one as long as a conversion is in progress.
-  //   When the conversion is complete, it returns to zero.
-  //   Writing zero to this bit has no effect."
-  // Start the measurement
-  ADCSRA = ADCSRA | _BV(ADSC);
-  // Poll-wait for the measurement to be done (it takes some time)
-  while (bit_is_set(ADCSRA, ADSC));
-  // The chapter of:
-  //  24.9.3 The ADC Data Register  ADCL and ADCH
-  // says:
-  //  "When ADCL is read, the ADC Data Register is not updated until ADCH is read.
-  //  Consequently, if the result is left adjusted and no more than 8 -
-  //  bit precision(7 bit + sign bit for differential input channels) is required, it is
-  //  sufficient to read ADCH. Otherwise, ADCL must be read first, then ADCH."
-  // Read ADCL first
-  low = ADCL;
-  high = ADCH;
-  // The chapter of:
-  //  24.6 Temperature Sensor
-  // says:
-  //  "The temperature sensor and its internal driver are enabled
-  //   when ADMUX value selects the temperature sensor as ADC input.
-  //   The propagation delay of this driver is approximately 2uS.
-  //   Therefore two successive conversions are required.
-  //   The correct temperature measurement will be the second one."
-  //
-  // So, delay for 2us and repeat the ADC measurement
-  //
-  delayMicroseconds(2); // this busy-loops the CPU in a calibrated execution loop
-  // Start the measurement
-  ADCSRA = ADCSRA | _BV(ADSC);
-  // Poll-wait for the measurement to be done
-  while (bit_is_set(ADCSRA, ADSC));
-  // Read and return the result
-  low = ADCL;
-  high = ADCH;
-  return (high << 8) | low;
+}
+
+bool ChipTempStore::load(ChipTempStoredState& state) {
+  uint8_t slot[CHIPTEMP_STORE_SLOT_SIZE];
+  if (!_scan(slot)) {
+    return false;
+  }
+  state._flags = slot[1];
+  state._calSlope = (int32_t)((uint32_t)slot[2] | ((uint32_t)slot[3] << 8)
+                                | ((uint32_t)slot[4] << 16) | ((uint32_t)slot[5] << 24));
+  state._calOffset = (int32_t)((uint32_t)slot[6] | ((uint32_t)slot[7] << 8)
+                                 | ((uint32_t)slot[8] << 16) | ((uint32_t)slot[9] << 24));
+  state._rawQ6 = (uint16_t)(slot[10] | ((uint16_t)slot[11] << 8));
+  return true;
+}
+
+void ChipTempStore::save(const ChipTempStoredState& state) {
+  uint8_t slot[CHIPTEMP_STORE_SLOT_SIZE];
+  if (!_scanned) {
+    _scan(slot);
+  }
+  slot[0] = _seq;
+  slot[1] = state._flags;
+  for (uint8_t i = 0; i < 4; ++i) {
+    slot[2 + i] = (uint8_t)((uint32_t)state._calSlope >> (8 * i));
+    slot[6 + i] = (uint8_t)((uint32_t)state._calOffset >> (8 * i));
+  }
+  slot[10] = (uint8_t)state._rawQ6;
+  slot[11] = (uint8_t)(state._rawQ6 >> 8);
+  slot[12] = chipTempStoreCrc(slot, CHIPTEMP_STORE_SLOT_SIZE - 1);
+  chipTemperatureEepromWrite_AVR(_address + (uint16_t)_next * CHIPTEMP_STORE_SLOT_SIZE,
+                                  slot, CHIPTEMP_STORE_SLOT_SIZE);
+  _next = (_next + 1 < _slots) ? (uint8_t)(_next + 1) : 0;
+  ++_seq;
+}
+
+bool ChipTempStore::_scan(uint8_t* slot) {
+  uint8_t candidate[CHIPTEMP_STORE_SLOT_SIZE];
+  bool found = false;
+  uint8_t latest = 0;
+  for (uint8_t i = 0; i < _slots; ++i) {
+    chipTemperatureEepromRead_AVR(_address + (uint16_t)i * CHIPTEMP_STORE_SLOT_SIZE,
+                                   candidate, CHIPTEMP_STORE_SLOT_SIZE);
+    if (chipTempStoreCrc(candidate, CHIPTEMP_STORE_SLOT_SIZE - 1)
+          != candidate[CHIPTEMP_STORE_SLOT_SIZE - 1]) {
+      continue;
+    }
+    // The valid sequence numbers are within _slots < 128 of each other,
+    //  so the signed difference compares them across the wraparound
+    if (found && ((int8_t)(candidate[0] - slot[0]) <= 0)) {
+      continue;
+    }
+    for (uint8_t j = 0; j < CHIPTEMP_STORE_SLOT_SIZE; ++j) {
+      slot[j] = candidate[j];
+    }
+    latest = i;
+    found = true;
+  }
+  _next = !found ? 0 : ((latest + 1 < _slots) ? (uint8_t)(latest + 1) : 0);
+  _seq = found ? (uint8_t)(slot[0] + 1) : 0;
+  _scanned = true;
+  return found;
+}
+
+ChipTempSampler::ChipTempSampler() :
+  _first(NULL)
+{
+}
+
+ChipTempSampler& ChipTempSampler::instance() {
+  static ChipTempSampler sampler;
+  return sampler;
+}
+
+void ChipTempSampler::subscribe(ChipTempSubscriber& view) {
+  // Not twice, or the list would loop
+  unsubscribe(view);
+  view._next = _first;
+  _first = &view;
+}
+
+void ChipTempSampler::unsubscribe(ChipTempSubscriber& view) {
+  for (ChipTempSubscriber** link = &_first; *link != NULL; link = &(*link)->_next) {
+    if (*link == &view) {
+      *link = view._next;
+      view._next = NULL;
+      return;
+    }
+  }
+}
+
+uint8_t ChipTempSampler::acquireBurst(uint8_t n) {
+  if (!_isBlocking()) {
+    return 0;
+  }
+  _prepareHwBurst();
+  for (uint8_t i = 0; i < n; ++i) {
+    uint16_t sample;
+    // Always true in the blocking modes
+    _acquire(sample);
+    _publish(sample);
+  }
+  return n;
+}
+
+void ChipTempSampler::_publish(uint16_t sample) {
+  for (ChipTempSubscriber* view = _first; view != NULL; view = view->_next) {
+    view->_onSample(sample);
+  }
+}
+
+ChipTempStream::ChipTempStream(uint8_t* buffer, uint16_t size) :
+  _buffer(buffer),
+  _size(size),
+  _lastRaw(0),
+  _lastTime(0),
+  _dropped(0),
+  _readRaw(0),
+  _readTime(0)
+{
+  clear();
+}
+
+uint16_t ChipTempStream::available() const {
+  return _used;
+}
+
+uint16_t ChipTempStream::droppedCount() const {
+  return _dropped;
+}
+
+bool ChipTempStream::read(uint16_t& rawQ6, uint32_t& timeUs) {
+  if (_used == 0) {
+    return false;
+  }
+  _skip(_decode());
+  rawQ6 = _readRaw;
+  timeUs = _readTime;
+  return true;
+}
+
+uint16_t ChipTempStream::drain(uint8_t* out, uint16_t size) {
+  uint16_t moved = 0;
+  while (_used != 0) {
+    uint8_t length = (_peek(0) == CHIPTEMP_STREAM_FULL) ? 7 : 3;
+    if ((uint16_t)(size - moved) < length) {
+      break;
+    }
+    for (uint8_t i = 0; i < length; ++i) {
+      out[moved++] = _peek(i);
+    }
+    // The decoder state must follow, for read() after drain()
+    _skip(_decode());
+  }
+  return moved;
+}
+
+void ChipTempStream::clear() {
+  _tail = 0;
+  _used = 0;
+  _resync = true;
+}
+
+void ChipTempStream::_onSample(uint16_t sample) {
+  uint32_t now = micros();
+  int16_t diff = (int16_t)(sample - _lastRaw);
+  // The finest scale the difference fits, with no bits lost
+  // Each oversampling step adds 2 fractional bits, so the readings of the hardware LSB
+  //  take the scale of 3, and the least oversampled ones of 2
+  uint8_t scale = 0;
+  while ((scale < 3) && ((diff < -127) || (diff > 127)) && ((diff & 3) == 0)) {
+    diff >>= 2;
+    ++scale;
+  }
+  // Rounded to the units, and counted from the rounded timestamp of the previous
+  //  sample, so the rounding errors do not add up
+  uint32_t ticks = (now - _lastTime + (1UL << (CHIPTEMP_STREAM_TIME_SHIFT - 1)))
+                     >> CHIPTEMP_STREAM_TIME_SHIFT;
+  bool full = _resync || (diff < -127) || (diff > 127) || (ticks > 0x3FFF);
+  if ((uint16_t)(_size - _used) < (full ? 7 : 3)) {
+    // No room, the consumer is late, the next record after a gap must be the full one
+    if (_dropped != 0xFFFF) {
+      ++_dropped;
+    }
+    _resync = true;
+    return;
+  }
+  if (full) {
+    _put(CHIPTEMP_STREAM_FULL);
+    _put((uint8_t)sample);
+    _put((uint8_t)(sample >> 8));
+    _put((uint8_t)now);
+    _put((uint8_t)(now >> 8));
+    _put((uint8_t)(now >> 16));
+    _put((uint8_t)(now >> 24));
+    _lastTime = now;
+    _resync = false;
+  } else {
+    _put((uint8_t)diff);
+    _put((uint8_t)ticks);
+    _put((uint8_t)((ticks >> 8) | (scale << 6)));
+    _lastTime += ticks << CHIPTEMP_STREAM_TIME_SHIFT;
+  }
+  _lastRaw = sample;
+}
+
+uint8_t ChipTempStream::_peek(uint16_t offset) const {
+  uint16_t index = ((uint16_t)(_size - _tail) > offset) ? (uint16_t)(_tail + offset)
+                                                        : (uint16_t)(_tail + offset - _size);
+  return _buffer[index];
+}
+
+void ChipTempStream::_skip(uint8_t length) {
+  _tail = ((uint16_t)(_size - _tail) > length) ? (uint16_t)(_tail + length)
+                                               : (uint16_t)(_tail + length - _size);
+  _used -= length;
+}
+
+void ChipTempStream::_put(uint8_t value) {
+  uint16_t index = ((uint16_t)(_size - _tail) > _used) ? (uint16_t)(_tail + _used)
+                                                       : (uint16_t)(_tail + _used - _size);
+  _buffer[index] = value;
+  ++_used;
+}
+
+uint8_t ChipTempStream::_decode() {
+  if (_peek(0) == CHIPTEMP_STREAM_FULL) {
+    _readRaw = (uint16_t)(_peek(1) | ((uint16_t)_peek(2) << 8));
+    _readTime = (uint32_t)_peek(3) | ((uint32_t)_peek(4) << 8)
+                  | ((uint32_t)_peek(5) << 16) | ((uint32_t)_peek(6) << 24);
+    return 7;
+  }
+  uint8_t high = _peek(2);
+  _readRaw = (uint16_t)(_readRaw + ((uint16_t)(int8_t)_peek(0) << (2 * (high >> 6))));
+  _readTime += (uint32_t)(_peek(1) | ((uint16_t)(high & 0x3F) << 8)) << CHIPTEMP_STREAM_TIME_SHIFT;
+  return 3;
 }
@@ -14,12 +14,43 @@
 
 // Check the hardware compatibility, and avoid linking-in unnecessary code
 
-#ifdef __AVR_ATmega32U4__
-uint16_t chipTemperatureReadRaw_m32U4();
+// The chip is selected at compile time, its header provides the ChipTempHw traits
+//  for the common AVR code of ChipTemperature_avr.cpp
+// CHIPTEMP_HW_SIM selects the host simulation instead of any chip,
+//  see ChipTemperature_sim.h
+#if defined(CHIPTEMP_HW_SIM)
+#include "ChipTemperature_sim.h"
+#elif defined(__AVR_ATmega32U4__)
+#define CHIPTEMP_HW_HEADER "ChipTemperature_m32u4.h"
+#elif defined(__AVR_ATmega328P__)
+#define CHIPTEMP_HW_HEADER "ChipTemperature_m328p.h"
+#elif defined(__AVR_ATtiny85__)
+#define CHIPTEMP_HW_HEADER "ChipTemperature_t85.h"
+#elif defined(__AVR_ATmega2560__)
+#error ATmega2560 (Arduino Mega) has no on-chip temperature sensor
 #else
-#error ChipTemperature is only supported for now on ATmega32U4 (Arduino Leonardo etc)
+#error ChipTemperature is only supported for now on ATmega32U4, ATmega328P and ATtiny85
 #endif
 
+// The hardware readers, the same for all chips, see ChipTemperature_avr.cpp
+// ChipTemperature_sim.cpp implements the same ones for CHIPTEMP_HW_SIM
+uint16_t chipTemperatureReadRaw_AVR();
+bool chipTemperatureReadRawAsync_AVR(uint16_t& reading, bool restart);
+uint16_t chipTemperatureReadRawSleep_AVR();
+void chipTemperatureStartAuto_AVR(uint8_t mode);
+void chipTemperatureStopAuto_AVR();
+bool chipTemperatureReadRawAuto_AVR(uint16_t& reading);
+void chipTemperatureFlushAuto_AVR();
+void chipTemperatureReleaseMux_AVR();
+void chipTemperatureSetSpeed_AVR(uint8_t speed);
+void chipTemperatureAnalogRead_AVR(const uint8_t* pins, uint16_t* values, uint8_t count);
+void chipTemperaturePrepareBurst_AVR();
+uint16_t chipTemperatureReadBandgap_AVR();
+bool chipTemperatureReadBandgapAsync_AVR(uint16_t& reading);
+bool chipTemperatureHasBandgap_AVR();
+void chipTemperatureEepromRead_AVR(uint16_t address, uint8_t* data, uint8_t size);
+void chipTemperatureEepromWrite_AVR(uint16_t address, const uint8_t* data, uint8_t size);
+
 // Constants
 
 // Kelvin temperature of 0C
@@ -37,37 +68,35 @@ uint16_t chipTemperatureReadRaw_m32U4();
 // Kelvin temperature is always in uint16_t to match the bit width of the hardware readings
 
 // Classes for calibration points
+// These are literal, trivially copyable types with constexpr constructors,
+//  so the calibration points (and tables of them) can be constexpr or PROGMEM,
+//  and the units conversions in them are done by the compiler
 
 // Calibration point of the temperature sensor (Kelvin)
 // tempK should be measured by external master thermometer during calibration
 // hwReading is the hardware reading (ChipTemperature::getRaw()) for the temperature of tempK
 struct ChipTempCalPointK {
-  const uint16_t _tempK;
-  const uint16_t _hwReading;
-  ChipTempCalPointK(uint16_t tempK, uint16_t hwReading) :
+  uint16_t _tempK;
+  uint16_t _hwReading;
+  constexpr ChipTempCalPointK(uint16_t tempK, uint16_t hwReading) :
     _tempK(tempK),
     _hwReading(hwReading) {}
-  ChipTempCalPointK(const ChipTempCalPointK& right) :
-    _tempK(right._tempK),
-    _hwReading(right._hwReading) {}
 };
 
 // Same as ChipTempCalPointK but in Celsius
 // Contains the same fields of _tempK and _hwReading
 struct ChipTempCalPointC : public ChipTempCalPointK {
-  ChipTempCalPointC(int tempC, uint16_t hwReading) :
+  constexpr ChipTempCalPointC(int tempC, uint16_t hwReading) :
     ChipTempCalPointK(
         // Celsius to Kelvin
         (uint16_t)(tempC + CHIPTEMP_CELSIUS_ZERO),
         hwReading) {}
-  ChipTempCalPointC(const ChipTempCalPointC& right) :
-    ChipTempCalPointK(right._tempK, right._hwReading) {}
 };
 
 // Same as ChipTempCalPointK but in Fahrenheit
 // Contains the same fields of _tempK and _hwReading
 struct ChipTempCalPointF : public ChipTempCalPointK {
-  ChipTempCalPointF(int tempF, uint16_t hwReading) :
+  constexpr ChipTempCalPointF(int tempF, uint16_t hwReading) :
     ChipTempCalPointK(
             // Fahrenheit to Kelvin
             (uint16_t)((((tempF - CHIPTEMP_FAHRENHEIT_0_C)
@@ -75,89 +104,1381 @@ struct ChipTempCalPointF : public ChipTempCalPointK {
                               / CHIPTEMP_FAHRENHEIT_DENOM)
                             + CHIPTEMP_CELSIUS_ZERO),
             hwReading) {}
-  ChipTempCalPointF(const ChipTempCalPointF& right) :
-    ChipTempCalPointK(right._tempK, right._hwReading) {}
 };
 
-// Number of samples used for averaging
-// getXxx() are valid only after this number of loops
+// Fixed-point calibration
+// The two calibration points are converted once to the linear function of
+//  K = slope * reading + offset
+//  with slope and offset in Q16.16 signed fixed point,
+//  so converting the reading to Kelvins needs no division
+#define CHIPTEMP_CAL_SHIFT              16
+// Added before the final shift to round to nearest instead of truncating
+#define CHIPTEMP_CAL_ROUND              ((int32_t)1 << (CHIPTEMP_CAL_SHIFT - 1))
+
+// Q16.16 slope of the calibration line, Kelvins per hardware reading unit
+// The points can go in any order, the sign is correct anyway
+// Equal hardware readings give zero slope (getK() becomes the constant tempK1)
+//  instead of division by zero
+constexpr int32_t chipTempCalSlope(uint16_t tempK1, uint16_t hwReading1,
+                                    uint16_t tempK2, uint16_t hwReading2) {
+  return (hwReading1 == hwReading2) ? 0 :
+          (((int32_t)tempK2 - (int32_t)tempK1) * ((int32_t)1 << CHIPTEMP_CAL_SHIFT))
+            / ((int32_t)hwReading2 - (int32_t)hwReading1);
+}
+
+// Q16.16 offset of the calibration line, Kelvins for zero hardware reading
+constexpr int32_t chipTempCalOffset(uint16_t tempK1, uint16_t hwReading1, int32_t slope) {
+  return (int32_t)tempK1 * ((int32_t)1 << CHIPTEMP_CAL_SHIFT) - slope * (int32_t)hwReading1;
+}
+
+// Segment of the multi-point piecewise-linear calibration,
+//  see the ChipTemperatureT constructor with the table of them
+// Built from the 2 neighbour calibration points by the compiler,
+//  so the table can be PROGMEM, and getK() does no division at runtime:
+//   const ChipTempCalSegment calTable[] PROGMEM = {
+//     ChipTempCalSegment(ChipTempCalPointC(-40, 269), ChipTempCalPointC(25, 352)),
+//     ChipTempCalSegment(ChipTempCalPointC(25, 352), ChipTempCalPointC(85, 432))
+//   };
+// The segments must go in the ascending order of the hardware readings,
+//  and, inside each, "from" must have the lower hardware reading
+struct ChipTempCalSegment {
+  // The hardware reading the segment starts from
+  // The segment goes till the start of the next one,
+  //  the first and the last segments are extrapolated beyond the table
+  uint16_t _hwReading;
+  // The calibration line of the segment, see chipTempCalSlope() and chipTempCalOffset()
+  int32_t _slope;
+  int32_t _offset;
+  constexpr ChipTempCalSegment(const ChipTempCalPointK& from, const ChipTempCalPointK& to) :
+    _hwReading(from._hwReading),
+    _slope(chipTempCalSlope(from._tempK, from._hwReading, to._tempK, to._hwReading)),
+    _offset(chipTempCalOffset(from._tempK, from._hwReading,
+                                chipTempCalSlope(from._tempK, from._hwReading,
+                                                  to._tempK, to._hwReading))) {}
+};
+
+// Fraction bits of the samples in the averaging buffer
+// The samples are Q10.6 unsigned fixed point hardware readings,
+//  so the oversampled readings (see ChipTemperatureT::setOversampling()) are not truncated
+#define CHIPTEMP_RAW_FRAC_BITS          6
+// Maximum oversampling rate, 4^3 = 64 readings per sample, 13 effective bits
+// 64 10-bit readings are summed exactly into the Q10.6 sample
+#define CHIPTEMP_OVERSAMPLING_MAX       3
+
+// The bandgap reading of ATmega32U4 with the nominal voltages, 1024 * 1.1V / 2.56V,
+//  see ChipTempAcquisition::setBandgapCorrection()
+#define CHIPTEMP_BANDGAP_NOMINAL        440
+// The bandgap is measured once per this number of samples
+#define CHIPTEMP_BANDGAP_INTERVAL       64
+
+// Default number of samples used for averaging, see ChipTemperature below
+// getXxx() are valid only after this number of samples, see ChipTemperatureT::isValid()
 // Before that, getXxx() will return something close to zero,
-//  and much lesser than the real value
-#define CHIPTEMP_SAMPLES_FOR_AVG        5
+//  and much lesser than the real value, unless ChipTemperatureT::setPrefill() is used
+// Must be a power of 2, so the averaging is a shift and not a division
+#define CHIPTEMP_SAMPLES_FOR_AVG        4
 
-// The main API class
-// Provides averaging and temperature units conversion for the hardware readings
-// No methods call delay() or analogs of any kind,
-//   in the worst case, only delayMicroseconds(2) is used
-// So, the class supports hard realtime
-class ChipTemperature {
+// The ADC_vect ISR of ChipTemperature_avr.cpp is only built with CHIPTEMP_USE_ADC_ISR
+//  defined for the whole build (by the compiler flags, not in the sketch),
+//  so the library does not take the ADC interrupt away from the other users
+//  if only CHIPTEMP_MODE_BLOCKING is needed
+// All the other modes need this ISR, without it setMode() refuses them and returns false
+// The Arduino IDE has no per-library flags, so the flag goes to the whole build:
+//  - arduino-cli: --build-property "compiler.cpp.extra_flags=-DCHIPTEMP_USE_ADC_ISR"
+//  - Arduino IDE: compiler.cpp.extra_flags=-DCHIPTEMP_USE_ADC_ISR
+//    in platform.local.txt next to the platform.txt of the AVR core
+//  - PlatformIO: build_flags = -DCHIPTEMP_USE_ADC_ISR
+// build.extra_flags works too, but replaces the USB flags of the ATmega32U4 boards
+
+// Hardware acquisition modes, see ChipTemperatureT::setMode()
+enum ChipTempMode {
+  // loop() does the whole reading by poll-waiting the ADC
+  // Takes 2 ADC conversions of CPU time on each loop(),
+  //  or only 1 if nobody used the ADC since the previous loop()
+  CHIPTEMP_MODE_BLOCKING,
+  // loop() only starts the reading and returns immediately,
+  //  the ADC interrupt completes it in background,
+  //  and the next loop() call collects the result
+  // Takes only several CPU cycles on each loop(), but:
+  //  - a new sample arrives on each 2nd-3rd loop() call, not on each one
+  //  - the ADC_vect interrupt is used by the library, see CHIPTEMP_USE_ADC_ISR
+  //  - the plain analogRead() is NOT safe in this mode: called while our conversion runs,
+  //    it does not start its own one (ADSC is already set), and its multiplexer setting
+  //    only applies to the next conversion, so it returns the sensor reading
+  //    Use chipTemperatureAnalogRead() instead, it waits for our conversion, and completes
+  //    the reading if it can
+  CHIPTEMP_MODE_ASYNC,
+  // Same as CHIPTEMP_MODE_BLOCKING, but the CPU sleeps in ADC Noise Reduction mode
+  //  during the conversions, and the ADC interrupt wakes it up
+  // Saves the power, and the readings are less noisy, so a lesser averaging window will do
+  // Timer0 and so millis() are stopped while sleeping, for ~104us per conversion
+  CHIPTEMP_MODE_SLEEP,
+  // The ADC is auto-triggered by Timer0 Compare Match A,
+  //  the multiplexer is set up only once, and the ADC_vect interrupt collects the readings
+  //  to the lock-free ring, loop() takes all of them from there
+  // Up to 7 readings between the loop() calls are kept, the further ones are dropped
+  // The sample rate is the Timer0 one, ~976Hz with the Arduino setup at 16MHz,
+  //  and is not affected by the loop() rate
+  // Use this only if the temperature sensor is the only ADC user,
+  //  analogRead() will take the ADC away, and the sampling will restart after it
+  // chipTemperatureAnalogRead() pauses the sampling for its time, and resumes it properly
+  CHIPTEMP_MODE_TIMER0,
+  // Same as CHIPTEMP_MODE_TIMER0, but with Timer1 Compare Match B
+  // The sample rate is the one configured for Timer1 by the sketch
+  // ATtiny85 cannot trigger the ADC by Timer1, Timer0 Compare Match B is used instead
+  CHIPTEMP_MODE_TIMER1
+};
+
+// Compile-time log2 for the averaging shifts
+constexpr uint8_t chipTempLog2(size_t n) { return (n <= 1) ? 0 : (uint8_t)(1 + chipTempLog2(n >> 1)); }
+
+// ADC clock profiles for the sensor conversions, see ChipTemperatureT::setSpeed()
+// Faster conversions are noisier, but the averaging (or oversampling)
+//  gets the noise back in the same time
+enum ChipTempSpeed {
+  // The ADC clock is not touched, usually /128 as set by the Arduino core
+  CHIPTEMP_SPEED_DEFAULT,
+  // ADC clock is F_CPU/128, 104us per conversion at 16MHz, full 10-bit accuracy
+  CHIPTEMP_SPEED_ACCURATE,
+  // ADC clock is F_CPU/32 (in high speed mode on ATmega32U4), 4 times faster
+  CHIPTEMP_SPEED_BALANCED,
+  // ADC clock is F_CPU/16 (in high speed mode on ATmega32U4), 8 times faster
+  CHIPTEMP_SPEED_FAST
+};
+
+// The acquisition part of ChipTemperatureT and ChipTempSampler: the hardware readings
+//  of the selected mode, the oversampling and the sample period
+// Implemented in ChipTemperature.cpp and not in this header,
+//  so all ChipTemperatureT<N> in the sketch share the same code
+class ChipTempAcquisition {
 public: // API
+  // Selects the hardware acquisition mode, CHIPTEMP_MODE_BLOCKING by default
+  // Should be called from setup(), not in the middle of the background reading
+  // Returns false and does nothing if the mode needs CHIPTEMP_USE_ADC_ISR, which is not set,
+  //  so only CHIPTEMP_MODE_BLOCKING is accepted without it
+  // Auto-triggered modes are started here, and stopped when switching to another mode
+  bool setMode(ChipTempMode mode);
+  // Selects the ADC clock for the sensor conversions, CHIPTEMP_SPEED_DEFAULT by default
+  // The ADC clock is switched only for the sensor conversions,
+  //  and is restored after them, so analogRead() is not affected
+  // Should be called from setup(), and before setMode()
+  void setSpeed(ChipTempSpeed speed);
+  // Selects the oversampling and decimation: each sample is the sum of 4^n hardware readings,
+  //  which gives 10+n effective bits, thanks to the 1..2 noise of the readings
+  // n is from 0 (no oversampling, the default) to CHIPTEMP_OVERSAMPLING_MAX
+  // In CHIPTEMP_MODE_BLOCKING, loop() does all 4^n readings at once,
+  //  in the other modes, it takes 4^n readings to produce the sample
+  // Good with CHIPTEMP_SPEED_FAST, which gets the time back
+  void setOversampling(uint8_t n);
+  // Limits the sample rate: a new sample is started no earlier than periodUs
+  //  microseconds after the start of the previous one, measured by micros()
+  // 0 (the default) means no limit, a new sample on each loop() if possible
+  // The very first sample has no previous one, and is started by the first loop() at once
+  // In between, loop() only compares micros() to the period, and returns
+  // The temperature changes over seconds, so a period of 10-100ms
+  //  frees the fast main loop of almost all ADC work
+  // The sample being acquired is always completed, even if the period is short
+  // In the auto-triggered modes, the timer readings done in between are dropped
+  //  when the new sample starts, so it is made of the fresh readings only
+  // Timer0 is stopped while sleeping in CHIPTEMP_MODE_SLEEP, so micros() runs
+  //  ~104us per conversion slower in this mode
+  void setSamplePeriod(uint32_t periodUs);
+  // Corrects the samples for the drift of the analog reference, 0 to stop (the default)
+  // Once per CHIPTEMP_BANDGAP_INTERVAL samples, one more reading measures the 1.1V bandgap
+  //  against the reference of the sensor, and all samples are scaled by
+  //  referenceQ6 / (the bandgap reading, averaged)
+  // referenceQ6 is the Q10.6 bandgap reading at the time of the calibration,
+  //  see getBandgapQ6(), or CHIPTEMP_BANDGAP_NOMINAL << CHIPTEMP_RAW_FRAC_BITS
+  // The scale is a precomputed Q2.14, so one multiply per sample, and the division
+  //  is only on each bandgap reading
+  // In CHIPTEMP_MODE_ASYNC, the bandgap reading is one more async reading before the sample
+  // The auto-triggered modes keep the multiplexer on the sensor, so the bandgap
+  //  cannot be measured there: returns false and does nothing in these modes,
+  //  and setMode() to them stops the correction
+  // ATmega32U4 only, its 2.56V reference of the sensor is the bandgap amplified,
+  //  on the chips where the reference is the bandgap itself, returns false and does nothing
+  bool setBandgapCorrection(uint16_t referenceQ6);
+  // Returns the averaged Q10.6 bandgap reading, 0 before the first one
+  uint16_t getBandgapQ6() const;
+protected: // for ChipTemperatureT and ChipTempSampler
+  ChipTempAcquisition();
+  // Returns true if the sample is being acquired, or the new one is due by the sample period
+  // Must be checked before _acquire(), inline so loop() is cheap when nothing is due
+  inline bool _isDue() __attribute__((always_inline));
+  // True for the modes where the reading is done by loop() itself, and not in background
+  bool _isBlocking() const {
+    return (_mode == CHIPTEMP_MODE_BLOCKING) || (_mode == CHIPTEMP_MODE_SLEEP);
+  }
+  // Sets the hardware up for a burst of readings, see ChipTemperatureT::acquireBurst()
+  static inline void _prepareHwBurst() __attribute__((always_inline));
+  // Does the hardware reading(s) of the current mode, and the oversampling
+  // Returns true and fills sample (Q10.6 hardware reading) if the new sample is complete
+  // In the non-blocking modes, costs only several CPU cycles if no sample is complete
+  bool _acquire(uint16_t& sample);
+private: // configuration
+  ChipTempMode _mode;
+  // Oversampling rate log4, see setOversampling()
+  uint8_t _osShift;
+  // See setSamplePeriod()
+  uint32_t _periodUs;
+private: // state fields
+  // micros() when the last sample was started
+  uint32_t _startUs;
+  // The sample was started and not completed yet, so _isDue() need not look at micros()
+  bool _sampling;
+  // Some sample was started, so _startUs is valid, and the first one is not delayed
+  bool _started;
+  // Sum of the hardware readings of the sample being oversampled
+  // 16 bits are enough for 4^CHIPTEMP_OVERSAMPLING_MAX 10-bit readings
+  uint16_t _osSum;
+  // Number of the hardware readings in _osSum
+  uint8_t _osCount;
+  // See setBandgapCorrection(), all are unused while _bgReferenceQ6 is 0
+  uint16_t _bgReferenceQ6;
+  // The exponential moving average of the bandgap readings, Q10.6, 0 before the first one
+  uint16_t _bgQ6;
+  // The scale of the samples, Q2.14
+  uint16_t _bgScale;
+  // Samples till the next bandgap reading, it is due at 0
+  uint8_t _bgCountdown;
+private: // internals
+  // Reads the temperature from the hardware without any averaging or conversions
+  static inline uint16_t _readHw() __attribute__((always_inline));
+  // Same as _readHw(), but sleeps instead of poll-waiting the ADC
+  static inline uint16_t _readHwSleep() __attribute__((always_inline));
+  // Non-blocking version of _readHw()
+  // Returns true and fills reading if the new one is available
+  // restart starts the next reading right after collecting this one
+  static inline bool _readHwAsync(uint16_t& reading, bool restart) __attribute__((always_inline));
+  // Same for the auto-triggered modes
+  static inline bool _readHwAuto(uint16_t& reading) __attribute__((always_inline));
+  // Drops the auto-triggered readings not collected yet
+  static inline void _flushHwAuto() __attribute__((always_inline));
+  // Starts and stops the auto-triggered modes
+  static inline void _startHwAuto(ChipTempMode mode) __attribute__((always_inline));
+  static inline void _stopHwAuto() __attribute__((always_inline));
+  // Selects the ADC clock for the hardware readings
+  static inline void _setHwSpeed(ChipTempSpeed speed) __attribute__((always_inline));
+  // Adds the bandgap reading to its average, and updates the scale of the samples
+  void _addBandgap(uint16_t reading);
+  // The mode is one of the auto-triggered ones
+  static bool _isAuto(ChipTempMode mode) {
+    return (mode == CHIPTEMP_MODE_TIMER0) || (mode == CHIPTEMP_MODE_TIMER1);
+  }
+  // Adds the new hardware reading to the oversampling
+  // Returns true and fills sample if the sample is complete
+  bool _addReading(uint16_t reading, uint16_t& sample);
+};
+
+// The calibration part of ChipTemperatureT and ChipTempViewT:
+//  the Q10.6 hardware reading to Q16.16 Kelvins
+// Implemented in ChipTemperature.cpp, same as ChipTempAcquisition
+class ChipTempCalibration {
+public: // API
+  // Switches the calibration to the lookup table of count entries,
+  //  the entry i is the Q10.6 Kelvins for the hardware reading of firstRaw + i
+  // The table is filled here by the current calibration (2-point or the segments),
+  //  so it must be called once, from setup(), after the calibration is set up
+  // lut is the RAM array, must live as long as the object
+  // getK() and getKQ16() are then only the table read and shifts, with no multiplies,
+  //  and take the same time for any reading, good for the hard realtime
+  // The sample is rounded to the integer hardware reading for the lookup,
+  //  so the fraction of the oversampling and averaging is lost
+  // The readings outside the table are clamped to its first and last entries,
+  //  the sensor's useful range is only several hundred codes,
+  //  e.g. 269..432 for -40..85C, 164 entries, 328 bytes
+  void buildLut(uint16_t* lut, uint16_t firstRaw, uint16_t count);
+  // Same as buildLut(), but the table is the ready PROGMEM one,
+  //  e.g. the one printed by the host simulation, see extras/sim/ChipTemperatureSim.cpp
+  void useLut(const uint16_t* lutProgmem, uint16_t firstRaw, uint16_t count);
+  // Recalculates the Q10.6 hardware reading to Q16.16 Kelvins against the calibration points,
+  //  e.g. for the samples of ChipTempStream
+  // 2 32-bit multiplies, adds and shifts, no division
+  // With the calibration table, plus the binary search of the segment,
+  //  log2(calCount) PROGMEM reads and compares
+  // With the lookup table, see buildLut(), only the table read
+  int32_t calibrate(uint16_t rawQ6) const;
+  // The inverse of calibrate(): returns the least Q10.6 hardware reading
+  //  which calibrates to kelvinQ16 or above, 0xFFFF if none does
+  // The binary search over the readings, 16 calibrations, so for the setup time only,
+  //  e.g. for ChipTempAlarm::setLimits()
+  // The calibration must be rising with the reading, as the sensor is
+  uint16_t uncalibrate(int32_t kelvinQ16) const;
+  // Switches to the 2-point calibration by these points, at runtime,
+  //  e.g. for the points measured on each board of the same firmware image
+  // The lookup table, if any, is dropped, call buildLut() again after this
+  // The divisions of chipTempCalSlope() and chipTempCalOffset() are done here, once
+  void setCalibration(const ChipTempCalPointK& calPoint1, const ChipTempCalPointK& calPoint2);
+protected: // for ChipTempWindowT
   // Initializes as uncalibrated (getK() == getRaw())
-  ChipTemperature();
+  ChipTempCalibration();
   // Initializes as calibrated with the provided calibration points
-  // The values in the calibration points can go in any order
-  // Surely ChipTempCalPointC/F are also OK for this call
-  ChipTemperature(const ChipTempCalPointK& calPoint1,
-                    const ChipTempCalPointK& calPoint2);
-  // Must be called on each loop() iteration
-  void loop();
+  ChipTempCalibration(const ChipTempCalPointK& calPoint1,
+                        const ChipTempCalPointK& calPoint2);
+  // Initializes as calibrated with the PROGMEM table of the calibration segments
+  ChipTempCalibration(const ChipTempCalSegment* calTable, uint8_t calCount);
+  // Same as calibrate(), but returns the cached result if the reading is the same
+  //  as the last time, which is the usual case, as the temperature changes slowly
+  // Can be called from an ISR, see _cacheSeq
+  int32_t _calibrateCached(uint16_t rawQ6) const;
+  // Returns the 2-point calibration line, for ChipTempStore
+  // Returns false with the calibration table, which is in PROGMEM and so is not stored
+  bool _getLine(int32_t& slope, int32_t& offset) const;
+  // Switches to the 2-point calibration line, see setCalibration()
+  void _setLine(int32_t slope, int32_t offset);
+private: // configuration
+  // The calibration line, precomputed from the 2 calibration points
+  //  by chipTempCalSlope() and chipTempCalOffset()
+  int32_t _calSlope;
+  int32_t _calOffset;
+  // PROGMEM table of the multi-point calibration, NULL for the 2-point one above
+  const ChipTempCalSegment* _calTable;
+  uint8_t _calCount;
+  // Lookup table of buildLut() or useLut(), NULL if not used
+  const uint16_t* _lut;
+  uint16_t _lutFirst;
+  uint16_t _lutCount;
+  bool _lutProgmem;
+private: // state fields
+  // The cache of _calibrateCached(), the last reading and its calibration
+  // Same seqlock-style as ChipTempWindowT::_sum, but any caller can be the writer:
+  //  _cacheSeq is odd while the cache is being written
+  // The caller which sees the odd _cacheSeq has interrupted the writer, so it neither
+  //  uses nor writes the cache; the one which sees _cacheSeq changed meanwhile
+  //  does not use the cache, but writes its own (complete and so consistent) result
+  mutable volatile uint16_t _cacheRaw;
+  mutable volatile int32_t _cacheKQ16;
+  mutable volatile uint8_t _cacheSeq;
+  mutable volatile bool _cacheValid;
+private: // internals
+  // Drops the cache, on the calibration change
+  void _invalidateCache();
+  // The calibration math itself, the 2-point line or the segments, without the lookup table
+  int32_t _calibrateLine(uint16_t rawQ6) const;
+  // Finds the segment of the calibration table for the reading,
+  //  and loads its calibration line
+  void _lookupSegment(uint16_t rawQ6, int32_t& slope, int32_t& offset) const;
+};
+
+// State of ChipTempAlarm
+enum ChipTempAlarmState {
+  // Between the limits
+  CHIPTEMP_ALARM_NORMAL,
+  // At or above the high limit, till it goes below it by the hysteresis
+  CHIPTEMP_ALARM_HIGH,
+  // Below the low limit, till it goes above it by the hysteresis
+  CHIPTEMP_ALARM_LOW
+};
+
+// The high and low temperature limits, checked on each new average,
+//  see ChipTempWindowT::setAlarm()
+// The limits are converted to the Q10.6 hardware readings once, by setLimits(),
+//  so the check per sample is only the integer compares, with no calibration math
+// The alarm is only checked when the averaging window is full
+// Implemented in ChipTemperature.cpp, same as ChipTempAcquisition
+class ChipTempAlarm {
+  template <size_t N, class Filter> friend class ChipTempWindowT;
+public: // API
+  // Called on each state change, from the loop() which added the sample
+  typedef void (*Callback)(ChipTempAlarm& alarm, ChipTempAlarmState state);
+  // No limits, the state stays CHIPTEMP_ALARM_NORMAL
+  ChipTempAlarm();
+  // Sets the limits in Q16.16 Kelvins, e.g. (int32_t)celsiusToKelvin(85) << CHIPTEMP_CAL_SHIFT,
+  //  against the calibration of the object the alarm is set to
+  // Must be called again if that calibration changes, e.g. by buildLut()
+  // The state is reset to CHIPTEMP_ALARM_NORMAL, and then follows the next average
+  void setLimits(const ChipTempCalibration& calibration,
+                   int32_t lowKQ16, int32_t highKQ16, int32_t hysteresisKQ16);
+  // Sets the callback of the state changes, NULL for none
+  void setCallback(Callback callback);
+  // Returns the current state
+  ChipTempAlarmState getState() const;
+  // Returns true once after each state change, for polling instead of the callback
+  bool hasFired();
+private: // configuration
+  // The Q10.6 hardware readings to enter and to leave each state, see setLimits()
+  uint16_t _highOn;
+  uint16_t _highOff;
+  uint16_t _lowOn;
+  uint16_t _lowOff;
+  Callback _callback;
+private: // state fields
+  volatile ChipTempAlarmState _state;
+  volatile bool _fired;
+private: // internals
+  // Checks the new Q10.6 average against the limits
+  inline void _check(uint16_t rawQ6) __attribute__((always_inline));
+  // Enters the new state, and reports it
+  void _enter(ChipTempAlarmState state);
+};
+
+// The state saved to EEPROM by ChipTempStore, see ChipTempWindowT::saveState()
+// The fields are valid by the CHIPTEMP_STORED_xxx bits of _flags
+#define CHIPTEMP_STORED_CALIBRATION     0x01
+#define CHIPTEMP_STORED_AVERAGE         0x02
+struct ChipTempStoredState {
+  uint8_t _flags;
+  // The 2-point calibration line, see ChipTempCalibration::setCalibration()
+  int32_t _calSlope;
+  int32_t _calOffset;
+  // The Q10.6 average, for the warm start
+  uint16_t _rawQ6;
+};
+
+// Bytes of one EEPROM slot of ChipTempStore, little-endian:
+//  uint8 sequence number, the fields of ChipTempStoredState (1 + 4 + 4 + 2 bytes),
+//  and CRC-8 (polynomial 0x07, initial 0xFF) of all the bytes before it
+// The initial 0xFF rejects both the erased (0xFF) and the zeroed slots
+#define CHIPTEMP_STORE_SLOT_SIZE        13
+
+// ChipTempStoredState in EEPROM, wear-levelled over a ring of slots
+// Each save() writes the next slot, with the sequence number incremented,
+//  and load() takes the valid slot with the latest sequence number
+// So, each slot is written once per slots saves, and an interrupted save()
+//  (a reset or a power loss) fails its CRC, and the previous state is loaded
+// The bytes are written by eeprom_update_block(), only the changed ones are erased
+// Implemented in ChipTemperature.cpp, same as ChipTempAcquisition
+class ChipTempStore {
+public: // API
+  // The area of slots * CHIPTEMP_STORE_SLOT_SIZE bytes from address
+  // slots is from 1 to 127, so the sequence numbers of the ring compare correctly
+  // EEPROM is not accessed here, so the objects can be global
+  ChipTempStore(uint16_t address, uint8_t slots);
+  // Loads the latest saved state, returns false if there is no valid one
+  bool load(ChipTempStoredState& state);
+  // Saves the state to the next slot
+  // ~3.4ms per changed byte, blocking, so not for each loop(),
+  //  but e.g. once per minutes or on the calibration
+  void save(const ChipTempStoredState& state);
+private: // initialization data
+  const uint16_t _address;
+  const uint8_t _slots;
+private: // state fields
+  // The slot and the sequence number of the next save(), valid if _scanned
+  uint8_t _next;
+  uint8_t _seq;
+  bool _scanned;
+private: // internals
+  // Finds the latest valid slot, and sets _next and _seq after it
+  // Returns false if there is none, and fills slot with its bytes if there is
+  bool _scan(uint8_t* slot);
+};
+
+// Filter stages applied to the samples before the averaging
+#include "ChipTemperature_filter.h"
+
+// The consumption part of ChipTemperatureT and ChipTempViewT:
+//  the filter, the averaging, the calibration and the getters
+// N is the number of samples used for averaging, must be a power of 2 up to 256
+// Filter is the stage (or ChipTempFilterChain of stages) from ChipTemperature_filter.h,
+//  applied to each new sample before the averaging, none by default
+// The boxcar averaging of N is the last stage, and N == 1 disables it
+template <size_t N, class Filter>
+class ChipTempWindowT : public ChipTempCalibration,
+                          // Not a field, so ChipTempFilterNone takes no RAM
+                          private Filter {
+  static_assert((N > 0) && ((N & (N - 1)) == 0), "ChipTemperatureT: N must be a power of 2");
+  static_assert(N <= 256, "ChipTemperatureT: N must fit the uint8_t ring buffer index");
+public: // API
+  // If true, the first sample after the construction fills the whole averaging window,
+  //  so getXxx() are valid after the first sample, and not after N of them
+  // Off by default, the window then fills with the real samples one by one
+  // Should be called from setup(), before the first loop()
+  void setPrefill(bool prefill);
+  // Returns the number of samples in the averaging window, from 0 to N
+  uint16_t sampleCount() const;
+  // Returns true if the averaging window is full, and so getXxx() are valid
+  bool isValid() const;
+  // Returns true once after each change of the average by a whole hardware LSB,
+  //  so the display or telemetry code can skip the unchanged temperatures
+  // getRaw() is compared, and not getRawQ6(): the 1..2 LSB noise of the readings
+  //  moves the fraction bits of the average on almost each sample
+  // For one consumer only, the others compare getGeneration() to their own copy
+  bool hasChanged();
+  // Returns the counter of the average changes, wrapping at 256
+  uint8_t getGeneration() const;
   // Returns the averaged temperature value as hardware reading
+  // Rounded to nearest, same as getK(), so the uncalibrated getK() is the same value
   // The return value is:
   //   - guaranteed to be linear with the real-world temperature
   //   - as the undocumented "as is" empirical fact, one can treat the value as K
   //   - but it can have error of 10K
   uint16_t getRaw() const;
+  // Same as getRaw(), but with the fraction part, Q10.6 unsigned fixed point
+  // getRaw(), getRawQ6() and getK() etc. can be called from an ISR,
+  //  even if it interrupted loop() in the middle of the update,
+  //  the result is then the previous one, and never a torn one
+  // No interrupts are disabled for this, see _seq
+  uint16_t getRawQ6() const;
   // Returns the averaged temperature value as Kelvins
   inline uint16_t getK() const __attribute__((always_inline));
-private: // initialization data
-  // 2 calibration points
-  // Their values can be in any order
-  const ChipTempCalPointK _calPoint1;
-  const ChipTempCalPointK _calPoint2;
+  // Same as getK(), but with the fraction part, Q16.16 signed fixed point
+  inline int32_t getKQ16() const __attribute__((always_inline));
+  // Fixed-point versions of getK() and of its Celsius/Fahrenheit conversions,
+  //  for sub-degree resolution without the floating point
+  // Returns the averaged temperature value as 0.01K units
+  inline int32_t getCentiK() const __attribute__((always_inline));
+  // Returns the averaged temperature value as 0.001C units
+  inline int32_t getMilliC() const __attribute__((always_inline));
+  // Returns the averaged temperature value as 0.001F units
+  inline int32_t getMilliF() const __attribute__((always_inline));
+  // Returns the rate of change of getKQ16(), Q16.16 Kelvins per second
+  // The least-squares line over the N filtered samples of the window,
+  //  kept up to date per sample at the constant cost (see _weighted),
+  //  times the average sample interval measured by micros(),
+  //  times the calibration gain at the current average
+  // 0 for N == 1, and until the window is full
+  // The call itself has 64-bit divisions, so is for the slow consumers, like the throttling,
+  //  and must be called from loop() (or with the sampling not interrupted), not from an ISR
+  int32_t getSlopeKQ16() const;
+  // Saves the 2-point calibration (not the table one) and the average,
+  //  if the window is full, to the EEPROM store
+  void saveState(ChipTempStore& store) const;
+  // Loads the state saved by saveState(), returns false if there is none
+  // The calibration is switched to the loaded one, see ChipTempCalibration::setCalibration(),
+  //  and the window is filled with the loaded average, so getXxx() are valid at once,
+  //  and the new samples then replace it one by one (the warm start)
+  // Should be called from setup(), before the first loop()
+  bool loadState(ChipTempStore& store);
+  // Checks the alarm limits on each new average, NULL to stop
+  // The alarm must live as long as it is set
+  void setAlarm(ChipTempAlarm* alarm);
+protected: // for ChipTemperatureT and ChipTempViewT
+  // Same as the constructors of ChipTempCalibration
+  ChipTempWindowT();
+  ChipTempWindowT(const ChipTempCalPointK& calPoint1, const ChipTempCalPointK& calPoint2);
+  ChipTempWindowT(const ChipTempCalSegment* calTable, uint8_t calCount);
+  // Passes the new Q10.6 sample through the filter, and adds it to the averaging
+  void _addSample(uint16_t sample);
 private: // state fields
-  // Last hardware readings measured
-  // Zeroes initially, but never mind - the first several loops will fill the array properly
-  uint16_t _samples[CHIPTEMP_SAMPLES_FOR_AVG];
+  // Last samples measured, Q10.6 hardware readings, a ring buffer
+  // Zeroes initially, the first N samples (or the prefill) will fill the array properly
+  uint16_t _samples[N];
+  // Index of the oldest sample in _samples, the next one to be overwritten
+  uint8_t _head;
+  // Running sum of _samples, so getRaw() does not rescan the array
+  // 32 bits are enough for any window size, 16-bit samples are summed
+  // _sum is a seqlock-style snapshot for the readers in the ISRs:
+  //  _seq is odd while _sum is being updated, and _sumPrev is the value before the update
+  // The reader which sees the odd _seq has interrupted the update,
+  //  so cannot wait for its end, and takes _sumPrev, which is not touched at this time
+  // The reader which sees the even _seq rereads if _seq changed meanwhile,
+  //  which can only happen if the update was done in an ISR which interrupted the reading
+  volatile uint32_t _sum;
+  volatile uint32_t _sumPrev;
+  volatile uint8_t _seq;
+  // Number of real samples in _samples, saturated at N, 16 bits since N can be 256
+  uint16_t _count;
+  // Sum of the samples weighted by their age, 0 for the oldest one to N - 1 for the newest,
+  //  so the least-squares slope is a closed form of it and _sum, see getSlopeKQ16()
+  // Fits 32 bits for N up to 256 of 16-bit samples
+  // When the oldest sample leaves, all others get 1 older, so the difference is
+  //  -(_sum - oldest) + (N - 1) * newest, and the cost does not depend on N
+  uint32_t _weighted;
+  // micros() of the last sample, and the exponential moving average of the intervals
+  //  between the samples, 0 before the 2nd sample
+  uint32_t _lastUs;
+  uint32_t _intervalUs;
+  // Incremented by _setSum() when getRaw() of the average changes, see getGeneration()
+  volatile uint8_t _generation;
+  // The generation last reported by hasChanged()
+  uint8_t _seenGeneration;
+private: // configuration
+  // See setPrefill()
+  bool _prefill;
+  // See setAlarm()
+  ChipTempAlarm* _alarm;
 private: // internals
+  // getRaw() divides the sum by N with this shift
+  static const uint8_t _AVG_SHIFT = chipTempLog2(N);
+  // The EMA of _intervalUs takes 1/2^_INTERVAL_SHIFT of each new interval
+  static const uint8_t _INTERVAL_SHIFT = 3;
   // Initializes all state fields to their initial values
   void _resetObject();
-  // Reads the temperature from the hardware without any averaging or conversions
-  inline uint16_t _readHw() const __attribute__((always_inline));
+  // Adds the filtered sample to the averaging
+  void _addFiltered(uint16_t sample);
+  // Fills the whole window by the sample, for the prefill and the warm start
+  void _fill(uint16_t sample);
+  // Publishes the new _sum to the readers, see _seq
+  void _setSum(uint32_t sum);
+  // The Q10.6 average rounded to the hardware reading, see getRaw()
+  // In 32 bits, the rounding carry of 0xFFFF does not fit 16
+  static uint16_t _roundRaw(uint32_t rawQ6) {
+    return (uint16_t)((rawQ6 + (1 << (CHIPTEMP_RAW_FRAC_BITS - 1))) >> CHIPTEMP_RAW_FRAC_BITS);
+  }
+};
+
+// See below, ChipTemperatureT::setStream() takes one
+class ChipTempSubscriber;
+
+// The main API class
+// Provides the acquisition, averaging and temperature units conversion
+//  for the hardware readings
+// N and Filter are the ones of ChipTempWindowT above
+// ChipTemperature below is the default one, with CHIPTEMP_SAMPLES_FOR_AVG samples
+// For several consumers of the same temperature, see ChipTempSampler and ChipTempViewT
+// No methods call delay() or analogs of any kind,
+//   in the worst case, only delayMicroseconds(2) is used,
+//   and in CHIPTEMP_MODE_ASYNC even the ADC is not poll-waited
+// So, the class supports hard realtime
+template <size_t N, class Filter = ChipTempFilterNone>
+class ChipTemperatureT : public ChipTempAcquisition,
+                          public ChipTempWindowT<N, Filter> {
+public: // API
+  // Initializes as uncalibrated (getK() == getRaw())
+  ChipTemperatureT();
+  // Initializes as calibrated with the provided calibration points
+  // The values in the calibration points can go in any order
+  // Surely ChipTempCalPointC/F are also OK for this call
+  ChipTemperatureT(const ChipTempCalPointK& calPoint1,
+                    const ChipTempCalPointK& calPoint2);
+  // Initializes as calibrated with the multi-point piecewise-linear calibration
+  // calTable is the PROGMEM array of calCount segments, see ChipTempCalSegment,
+  //  and must live as long as the object, calCount must be from 1 to 255
+  // The sensor bends at the range extremes, and the segments follow the bend
+  ChipTemperatureT(const ChipTempCalSegment* calTable, uint8_t calCount);
+  // Must be called on each loop() iteration
+  void loop();
+  // Also gives each new sample to the stream (see ChipTempStream), NULL to stop
+  void setStream(ChipTempSubscriber* stream);
+  // Does n samples back-to-back, and feeds all of them to the filter and the averaging
+  // The multiplexer and the analog reference are set up once for the whole burst,
+  //  and, if they were switched by some other ADC user, one more reading is discarded
+  //  to let the reference settle, so the samples are not biased by it
+  // Blocks for n samples (with the oversampling, for 4^k readings each),
+  //  good for setup(), or to fill the window at once after a long sample period
+  // Only for CHIPTEMP_MODE_BLOCKING and CHIPTEMP_MODE_SLEEP, does nothing in the others
+  // Returns the number of samples done, n or 0
+  uint8_t acquireBurst(uint8_t n);
+private: // configuration
+  // See setStream()
+  ChipTempSubscriber* _stream;
+private: // internals
+  // Adds the new sample to the averaging, and to the stream
+  void _addSample(uint16_t sample);
+};
+
+// The default ChipTemperature, with CHIPTEMP_SAMPLES_FOR_AVG samples for averaging
+typedef ChipTemperatureT<CHIPTEMP_SAMPLES_FOR_AVG> ChipTemperature;
+
+// Receiver of the samples of ChipTempSampler, see ChipTempViewT
+class ChipTempSubscriber {
+  friend class ChipTempSampler;
+  template <size_t N, class Filter> friend class ChipTemperatureT;
+protected:
+  ChipTempSubscriber() : _next(NULL) {}
+  // Called by ChipTempSampler::loop() for each new Q10.6 sample
+  virtual void _onSample(uint16_t sample) = 0;
+private: // state fields
+  // Next one in the list of ChipTempSampler
+  ChipTempSubscriber* _next;
+};
+
+// The single acquisition stream of the temperature sensor for several consumers
+// Each consumer (fan control, logging, overheat watchdog...) is a ChipTempViewT
+//  with its own filter, window and calibration, subscribed to the sampler
+// The sampler does the hardware readings once per sample,
+//  and gives the sample to all its subscribers,
+//  so the ADC time does not grow with the number of consumers
+// There is only one sensor, and the hardware readers are shared,
+//  so there is only one sampler, see instance()
+// The acquisition setup (setMode() etc.) is the same as in ChipTemperatureT
+class ChipTempSampler : public ChipTempAcquisition {
+public: // API
+  // Returns the only sampler
+  // Created on the first call, so it costs nothing if not used
+  static ChipTempSampler& instance();
+  // Adds the view to the ones which receive the samples
+  // The view must live till unsubscribe(), or forever
+  void subscribe(ChipTempSubscriber& view);
+  // Removes the view from the ones which receive the samples
+  void unsubscribe(ChipTempSubscriber& view);
+  // Must be called on each loop() iteration, instead of loop() of the views
+  inline void loop() __attribute__((always_inline));
+  // Same as ChipTemperatureT::acquireBurst(), for all the views
+  uint8_t acquireBurst(uint8_t n);
+private: // initialization
+  ChipTempSampler();
+  ChipTempSampler(const ChipTempSampler&);
+  ChipTempSampler& operator=(const ChipTempSampler&);
+private: // state fields
+  // The list of the subscribed views
+  ChipTempSubscriber* _first;
+private: // internals
+  // Gives the sample to all views
+  void _publish(uint16_t sample);
+};
+
+// The consumer of ChipTempSampler samples
+// Same as ChipTemperatureT, but with no acquisition of its own and no loop()
+// Takes only the RAM of its window and calibration, and the time of its filter
+template <size_t N, class Filter = ChipTempFilterNone>
+class ChipTempViewT : public ChipTempSubscriber,
+                        public ChipTempWindowT<N, Filter> {
+public: // API
+  // Same as the ones of ChipTemperatureT
+  ChipTempViewT();
+  ChipTempViewT(const ChipTempCalPointK& calPoint1, const ChipTempCalPointK& calPoint2);
+  ChipTempViewT(const ChipTempCalSegment* calTable, uint8_t calCount);
+private: // internals
+  virtual void _onSample(uint16_t sample);
 };
 
+// Bits of the time deltas dropped by ChipTempStream, 64us units,
+//  so up to ~1s between the samples fits the 14-bit delta
+#define CHIPTEMP_STREAM_TIME_SHIFT      6
+// The first byte of the full record, see ChipTempStream
+#define CHIPTEMP_STREAM_FULL            0x80
+
+// The history of the samples with their micros() timestamps, for the bulk logging
+// Subscribe it to ChipTempSampler, or set it by ChipTemperatureT::setStream()
+// The samples (Q10.6 hardware readings, before the filter) are kept in the compact form
+//  in the byte ring buffer provided by the sketch, little-endian:
+//   - the delta record, 3 bytes: int8 sample difference (not -128),
+//     uint16 of the time difference in 2^CHIPTEMP_STREAM_TIME_SHIFT us units (bits 13:0)
+//     and of the scale s of the sample difference (bits 15:14), in 4^s Q10.6 units
+//     (1 is the hardware LSB, as the samples are not oversampled, see setOversampling())
+//   - the full record, 7 bytes: CHIPTEMP_STREAM_FULL, uint16 sample, uint32 micros()
+// The full record is the first one, and the one after anything not fitting the delta,
+//  or after the samples dropped on the buffer overflow
+// Drain it by read() one by one, or by drain() in batches of whole encoded records,
+//  which can go to SD or Serial as is, and be decoded later
+class ChipTempStream : public ChipTempSubscriber {
+public: // API
+  // buffer of size bytes must live as long as the object
+  ChipTempStream(uint8_t* buffer, uint16_t size);
+  // Returns the number of the encoded bytes stored
+  uint16_t available() const;
+  // Returns the number of the samples dropped since the construction,
+  //  since the buffer was full
+  uint16_t droppedCount() const;
+  // Takes the oldest sample, returns false if there is none
+  // rawQ6 is the sample, timeUs is its micros() timestamp,
+  //  the deltas round it to 2^CHIPTEMP_STREAM_TIME_SHIFT us with no accumulating error
+  bool read(uint16_t& rawQ6, uint32_t& timeUs);
+  // Moves up to size bytes of the whole encoded records to out,
+  //  returns the number of bytes moved
+  // read() and drain() can be mixed
+  uint16_t drain(uint8_t* out, uint16_t size);
+  // Drops all the stored samples
+  void clear();
+private: // initialization data
+  uint8_t* const _buffer;
+  const uint16_t _size;
+private: // state fields
+  // The ring buffer: the oldest byte, and the number of the stored bytes
+  uint16_t _tail;
+  uint16_t _used;
+  // The encoder state, the last sample stored and its rounded timestamp
+  uint16_t _lastRaw;
+  uint32_t _lastTime;
+  // The next record must be the full one
+  bool _resync;
+  uint16_t _dropped;
+  // The decoder state, the last sample taken
+  uint16_t _readRaw;
+  uint32_t _readTime;
+private: // internals
+  virtual void _onSample(uint16_t sample);
+  // Returns the byte at offset from the tail
+  uint8_t _peek(uint16_t offset) const;
+  // Drops length bytes at the tail
+  void _skip(uint8_t length);
+  // Appends the byte, the room must be checked before
+  void _put(uint8_t value);
+  // Decodes the oldest record to the decoder state, returns its length
+  uint8_t _decode();
+};
+
+// Must be called by the code which uses the ADC and then restores ADMUX
+//  to the temperature sensor selection, or disables the ADC
+// The next reading will then do the discarded conversion to let the sensor driver settle
+// analogRead() needs no such call, it is detected by the ADMUX contents
+inline void chipTemperatureReleaseMux() __attribute__((always_inline));
+
+// analogRead() coordinated with the background readings of CHIPTEMP_MODE_ASYNC
+//  and the auto-triggered modes
+// The background reading is paused (or completed) for the time of analogRead(),
+//  and resumed after it, so neither of the readings is torn or dropped unnecessarily
+// Must be called from the foreground code, not from the ISRs
+inline uint16_t chipTemperatureAnalogRead(uint8_t pin) __attribute__((always_inline));
+// Same for a group of pins, values[i] is the reading of pins[i]
+// Group the other channels to the single call, so the analog reference is switched
+//  away from the sensor one and back only once, and its settling is paid only once
+inline void chipTemperatureAnalogRead(const uint8_t* pins, uint16_t* values, uint8_t count)
+  __attribute__((always_inline));
+
+void chipTemperatureReleaseMux() {
+  chipTemperatureReleaseMux_AVR();
+}
+
+uint16_t chipTemperatureAnalogRead(uint8_t pin) {
+  uint16_t value;
+  chipTemperatureAnalogRead_AVR(&pin, &value, 1);
+  return value;
+}
+
+void chipTemperatureAnalogRead(const uint8_t* pins, uint16_t* values, uint8_t count) {
+  chipTemperatureAnalogRead_AVR(pins, values, count);
+}
+
 // Temperature unit conversion functions
 // Their names are self-speaking
+// All are constexpr, so they cost nothing at runtime for constant arguments
 
-inline int kelvinToCelsius(uint16_t kelvin) __attribute__((always_inline));
-inline uint16_t celsiusToKelvin(int celsius) __attribute__((always_inline));
-inline int celsiusToFahrenheit(int celsius) __attribute__((always_inline));
+constexpr int kelvinToCelsius(uint16_t kelvin) __attribute__((always_inline));
+constexpr uint16_t celsiusToKelvin(int celsius) __attribute__((always_inline));
+constexpr int celsiusToFahrenheit(int celsius) __attribute__((always_inline));
+// Fixed-point versions, from Q16.16 Kelvins (ChipTemperatureT::getKQ16())
+// No division, only multiplies by constants and shifts, rounded to nearest
+// 0C is CHIPTEMP_CELSIUS_ZERO exactly, same as in the integer versions
+constexpr int32_t kelvinQ16ToCentiKelvin(int32_t kelvinQ16) __attribute__((always_inline));
+constexpr int32_t kelvinQ16ToMilliCelsius(int32_t kelvinQ16) __attribute__((always_inline));
+constexpr int32_t kelvinQ16ToMilliFahrenheit(int32_t kelvinQ16) __attribute__((always_inline));
 
 // Bodies of public inlines
 
-int kelvinToCelsius(uint16_t kelvin) { return (int)kelvin - CHIPTEMP_CELSIUS_ZERO; }
+constexpr int kelvinToCelsius(uint16_t kelvin) { return (int)kelvin - CHIPTEMP_CELSIUS_ZERO; }
 
-uint16_t celsiusToKelvin(int celsius) { return (uint16_t)(celsius + CHIPTEMP_CELSIUS_ZERO); }
+constexpr uint16_t celsiusToKelvin(int celsius) { return (uint16_t)(celsius + CHIPTEMP_CELSIUS_ZERO); }
 
-int celsiusToFahrenheit(int celsius) {
-    return (celsius * CHIPTEMP_FAHRENHEIT_NUM) / CHIPTEMP_FAHRENHEIT_DENOM
+constexpr int celsiusToFahrenheit(int celsius) {
+    // 1C = (CHIPTEMP_FAHRENHEIT_DENOM/CHIPTEMP_FAHRENHEIT_NUM) * 1F
+    return (celsius * CHIPTEMP_FAHRENHEIT_DENOM) / CHIPTEMP_FAHRENHEIT_NUM
             + CHIPTEMP_FAHRENHEIT_0_C;
 }
 
-uint16_t ChipTemperature::getK() const {
- !!! check for signs - getRaw() is the maximum, reverse order
- // Recalculation against the calibration points
- // The sign is always correct, even if the points go in reverse order
- return (uint16_t)(((((long)getRaw() - (long)_calPoint1._hwReading)
-                         * ((long)_calPoint2._tempK - (long)_calPoint1._tempK))
-                       / ((long)_calPoint2._hwReading - (long)_calPoint1._hwReading))
-                     + (long)_calPoint1._tempK);
+// The multiplications are done in lesser precision (Q.12 and Q.10)
+//  to fit 32 bits for any temperature the sensor can read
+
+constexpr int32_t kelvinQ16ToCentiKelvin(int32_t kelvinQ16) {
+    return ((kelvinQ16 >> 4) * 100 + ((int32_t)1 << 11)) >> 12;
 }
 
-uint16_t ChipTemperature::_readHw() const {
-  // Avoid linking-in unnecessary code
-#ifdef __AVR_ATmega32U4__
-  return chipTemperatureReadRaw_m32U4();
-#endif
+constexpr int32_t kelvinQ16ToMilliCelsius(int32_t kelvinQ16) {
+    return (((kelvinQ16 - ((int32_t)CHIPTEMP_CELSIUS_ZERO << 16)) >> 6) * 1000
+              + ((int32_t)1 << 9)) >> 10;
+}
+
+constexpr int32_t kelvinQ16ToMilliFahrenheit(int32_t kelvinQ16) {
+    // 1C = 1.8F, the factor is folded by the compiler
+    return ((((kelvinQ16 - ((int32_t)CHIPTEMP_CELSIUS_ZERO << 16)) >> 6)
+                * (1000 * CHIPTEMP_FAHRENHEIT_DENOM / CHIPTEMP_FAHRENHEIT_NUM)
+              + ((int32_t)1 << 9)) >> 10)
+            + (int32_t)CHIPTEMP_FAHRENHEIT_0_C * 1000;
+}
+
+// Bodies of ChipTempAcquisition and ChipTempCalibration inlines
+
+inline ChipTempAcquisition::ChipTempAcquisition() :
+  _mode(CHIPTEMP_MODE_BLOCKING),
+  _osShift(0),
+  _periodUs(0),
+  _startUs(0),
+  _sampling(false),
+  _started(false),
+  _osSum(0),
+  _osCount(0),
+  _bgReferenceQ6(0),
+  _bgQ6(0),
+  _bgScale(1 << 14),
+  _bgCountdown(0)
+{
+}
+
+bool ChipTempAcquisition::_isDue() {
+  if (_sampling || (_periodUs == 0)) {
+    return true;
+  }
+  uint32_t now = micros();
+  // Correct across the micros() wraparound, the subtraction is modulo 2^32
+  // There is no previous sample to wait for on the first call
+  if (_started && ((uint32_t)(now - _startUs) < _periodUs)) {
+    return false;
+  }
+  _startUs = now;
+  _sampling = true;
+  _started = true;
+  if (_isAuto(_mode)) {
+    // The ring is full of the readings done since the previous sample, ~a period ago
+    _flushHwAuto();
+  }
+  return true;
+}
+
+uint16_t ChipTempAcquisition::_readHw() {
+  return chipTemperatureReadRaw_AVR();
+}
+
+uint16_t ChipTempAcquisition::_readHwSleep() {
+  return chipTemperatureReadRawSleep_AVR();
+}
+
+bool ChipTempAcquisition::_readHwAsync(uint16_t& reading, bool restart) {
+  return chipTemperatureReadRawAsync_AVR(reading, restart);
+}
+
+bool ChipTempAcquisition::_readHwAuto(uint16_t& reading) {
+  return chipTemperatureReadRawAuto_AVR(reading);
+}
+
+void ChipTempAcquisition::_flushHwAuto() {
+  chipTemperatureFlushAuto_AVR();
+}
+
+void ChipTempAcquisition::_startHwAuto(ChipTempMode mode) {
+  chipTemperatureStartAuto_AVR((uint8_t)mode);
+}
+
+void ChipTempAcquisition::_stopHwAuto() {
+  chipTemperatureStopAuto_AVR();
+}
+
+void ChipTempAcquisition::_prepareHwBurst() {
+  chipTemperaturePrepareBurst_AVR();
+}
+
+void ChipTempAcquisition::_setHwSpeed(ChipTempSpeed speed) {
+  chipTemperatureSetSpeed_AVR((uint8_t)speed);
+}
+
+inline ChipTempCalibration::ChipTempCalibration() :
+  // Uncalibrated: the identity mapping, so getK() == getRaw()
+  _calSlope((int32_t)1 << CHIPTEMP_CAL_SHIFT),
+  _calOffset(0),
+  _calTable(NULL),
+  _calCount(0),
+  _lut(NULL),
+  _lutFirst(0),
+  _lutCount(0),
+  _lutProgmem(false),
+  _cacheRaw(0),
+  _cacheKQ16(0),
+  _cacheSeq(0),
+  _cacheValid(false)
+{
+}
+
+inline ChipTempCalibration::ChipTempCalibration(const ChipTempCalPointK& calPoint1,
+                                                  const ChipTempCalPointK& calPoint2) :
+  // The only divisions of the calibration math are here, and not in getK()
+  // They are folded by the compiler if the calibration points are constants
+  _calSlope(chipTempCalSlope(calPoint1._tempK, calPoint1._hwReading,
+                              calPoint2._tempK, calPoint2._hwReading)),
+  _calOffset(chipTempCalOffset(calPoint1._tempK, calPoint1._hwReading,
+                                chipTempCalSlope(calPoint1._tempK, calPoint1._hwReading,
+                                                  calPoint2._tempK, calPoint2._hwReading))),
+  _calTable(NULL),
+  _calCount(0),
+  _lut(NULL),
+  _lutFirst(0),
+  _lutCount(0),
+  _lutProgmem(false),
+  _cacheRaw(0),
+  _cacheKQ16(0),
+  _cacheSeq(0),
+  _cacheValid(false)
+{
+}
+
+inline ChipTempCalibration::ChipTempCalibration(const ChipTempCalSegment* calTable,
+                                                  uint8_t calCount) :
+  // Not used with the table
+  _calSlope(0),
+  _calOffset(0),
+  _calTable(calTable),
+  _calCount(calCount),
+  _lut(NULL),
+  _lutFirst(0),
+  _lutCount(0),
+  _lutProgmem(false),
+  _cacheRaw(0),
+  _cacheKQ16(0),
+  _cacheSeq(0),
+  _cacheValid(false)
+{
+}
+
+// Bodies of ChipTempAlarm inlines
+
+void ChipTempAlarm::_check(uint16_t rawQ6) {
+  switch (_state) {
+  case CHIPTEMP_ALARM_NORMAL:
+    if (rawQ6 >= _highOn) {
+      _enter(CHIPTEMP_ALARM_HIGH);
+    } else if (rawQ6 < _lowOn) {
+      _enter(CHIPTEMP_ALARM_LOW);
+    }
+    break;
+  case CHIPTEMP_ALARM_HIGH:
+    if (rawQ6 < _highOff) {
+      _enter(CHIPTEMP_ALARM_NORMAL);
+    }
+    break;
+  case CHIPTEMP_ALARM_LOW:
+    if (rawQ6 >= _lowOff) {
+      _enter(CHIPTEMP_ALARM_NORMAL);
+    }
+    break;
+  }
+}
+
+// Bodies of ChipTempWindowT members
+
+template <size_t N, class Filter>
+ChipTempWindowT<N, Filter>::ChipTempWindowT() :
+  ChipTempCalibration(),
+  _prefill(false),
+  _alarm(NULL)
+{
+  _resetObject();
+}
+
+template <size_t N, class Filter>
+ChipTempWindowT<N, Filter>::ChipTempWindowT(const ChipTempCalPointK& calPoint1,
+                                              const ChipTempCalPointK& calPoint2) :
+  ChipTempCalibration(calPoint1, calPoint2),
+  _prefill(false),
+  _alarm(NULL)
+{
+  _resetObject();
+}
+
+template <size_t N, class Filter>
+ChipTempWindowT<N, Filter>::ChipTempWindowT(const ChipTempCalSegment* calTable,
+                                              uint8_t calCount) :
+  ChipTempCalibration(calTable, calCount),
+  _prefill(false),
+  _alarm(NULL)
+{
+  _resetObject();
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::setPrefill(bool prefill) {
+  _prefill = prefill;
+}
+
+template <size_t N, class Filter>
+int32_t ChipTempWindowT<N, Filter>::getSlopeKQ16() const {
+  if ((N < 2) || !isValid() || (_intervalUs == 0)) {
+    return 0;
+  }
+  // The least-squares slope of y over the ages k = 0..N-1 is:
+  //  sum((k - (N - 1) / 2) * y) / sum((k - (N - 1) / 2)^2)
+  //  = (2 * _weighted - (N - 1) * _sum) * 6 / (N * (N^2 - 1))
+  // In the Q10.6 units per sample, and shifted by 10 to Q16.16 hardware LSBs per sample
+  // The divisor is in 64 bits, size_t is 16 bits on AVR, and N * (N^2 - 1) needs 24
+  int64_t centered = 2 * (int64_t)_weighted - (int64_t)(N - 1) * (int64_t)_sum;
+  int64_t perSample = (centered * (6 << (CHIPTEMP_CAL_SHIFT - CHIPTEMP_RAW_FRAC_BITS)))
+                        / ((int64_t)N * ((int64_t)N * N - 1));
+  // Hardware LSBs per second, clamped to 32 bits, which is far above any real slope,
+  //  so the multiply by the gain below cannot overflow
+  int64_t perSecond = perSample * 1000000 / (int64_t)_intervalUs;
+  if (perSecond > (int64_t)0x7FFFFFFF) {
+    perSecond = (int64_t)0x7FFFFFFF;
+  } else if (perSecond < -(int64_t)0x7FFFFFFF) {
+    perSecond = -(int64_t)0x7FFFFFFF;
+  }
+  // The calibration gain, Q16.16 Kelvins per hardware LSB, around the average
+  // Symmetric, so it is the mean gain of the two segments at a segment boundary
+  uint16_t rawQ6 = (uint16_t)(_sum >> _AVG_SHIFT);
+  uint16_t below = (rawQ6 < (1 << CHIPTEMP_RAW_FRAC_BITS)) ? 0
+                     : (uint16_t)(rawQ6 - (1 << CHIPTEMP_RAW_FRAC_BITS));
+  uint16_t above = (rawQ6 > 0xFFFF - (1 << CHIPTEMP_RAW_FRAC_BITS)) ? 0xFFFF
+                     : (uint16_t)(rawQ6 + (1 << CHIPTEMP_RAW_FRAC_BITS));
+  int64_t gain = ((int64_t)(calibrate(above) - calibrate(below)) << CHIPTEMP_RAW_FRAC_BITS)
+                   / (int64_t)(above - below);
+  int64_t slope = (perSecond * gain) >> CHIPTEMP_CAL_SHIFT;
+  return (slope > (int64_t)0x7FFFFFFF) ? (int32_t)0x7FFFFFFF
+           : ((slope < -(int64_t)0x7FFFFFFF) ? -(int32_t)0x7FFFFFFF : (int32_t)slope);
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::saveState(ChipTempStore& store) const {
+  ChipTempStoredState state;
+  state._flags = 0;
+  state._calSlope = 0;
+  state._calOffset = 0;
+  state._rawQ6 = 0;
+  if (_getLine(state._calSlope, state._calOffset)) {
+    state._flags |= CHIPTEMP_STORED_CALIBRATION;
+  }
+  if (isValid()) {
+    state._rawQ6 = getRawQ6();
+    state._flags |= CHIPTEMP_STORED_AVERAGE;
+  }
+  store.save(state);
+}
+
+template <size_t N, class Filter>
+bool ChipTempWindowT<N, Filter>::loadState(ChipTempStore& store) {
+  ChipTempStoredState state;
+  if (!store.load(state)) {
+    return false;
+  }
+  if ((state._flags & CHIPTEMP_STORED_CALIBRATION) != 0) {
+    _setLine(state._calSlope, state._calOffset);
+  }
+  if ((state._flags & CHIPTEMP_STORED_AVERAGE) != 0) {
+    _fill(state._rawQ6);
+  }
+  return true;
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::setAlarm(ChipTempAlarm* alarm) {
+  _alarm = alarm;
+}
+
+template <size_t N, class Filter>
+uint16_t ChipTempWindowT<N, Filter>::sampleCount() const {
+  return _count;
+}
+
+template <size_t N, class Filter>
+bool ChipTempWindowT<N, Filter>::isValid() const {
+  return _count == N;
+}
+
+template <size_t N, class Filter>
+bool ChipTempWindowT<N, Filter>::hasChanged() {
+  uint8_t generation = _generation;
+  if (generation == _seenGeneration) {
+    return false;
+  }
+  _seenGeneration = generation;
+  return true;
+}
+
+template <size_t N, class Filter>
+uint8_t ChipTempWindowT<N, Filter>::getGeneration() const {
+  return _generation;
+}
+
+template <size_t N, class Filter>
+uint16_t ChipTempWindowT<N, Filter>::getRaw() const {
+  return _roundRaw(getRawQ6());
+}
+
+template <size_t N, class Filter>
+uint16_t ChipTempWindowT<N, Filter>::getRawQ6() const {
+  uint32_t sum;
+  uint8_t seq;
+  do {
+    seq = _seq;
+    if ((seq & 1) != 0) {
+      // We interrupted the update
+      sum = _sumPrev;
+      break;
+    }
+    sum = _sum;
+  } while (seq != _seq);
+  return (uint16_t)(sum >> _AVG_SHIFT);
+}
+
+template <size_t N, class Filter>
+uint16_t ChipTempWindowT<N, Filter>::getK() const {
+  // Rounded to nearest, the fraction of the reading is not lost
+  return (uint16_t)((getKQ16() + CHIPTEMP_CAL_ROUND) >> CHIPTEMP_CAL_SHIFT);
+}
+
+template <size_t N, class Filter>
+int32_t ChipTempWindowT<N, Filter>::getKQ16() const {
+  return _calibrateCached(getRawQ6());
+}
+
+template <size_t N, class Filter>
+int32_t ChipTempWindowT<N, Filter>::getCentiK() const {
+  return kelvinQ16ToCentiKelvin(getKQ16());
+}
+
+template <size_t N, class Filter>
+int32_t ChipTempWindowT<N, Filter>::getMilliC() const {
+  return kelvinQ16ToMilliCelsius(getKQ16());
+}
+
+template <size_t N, class Filter>
+int32_t ChipTempWindowT<N, Filter>::getMilliF() const {
+  return kelvinQ16ToMilliFahrenheit(getKQ16());
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::_resetObject() {
+  for (size_t i = 0; i < N; ++i) {
+    _samples[i] = 0;
+  }
+  _head = 0;
+  _sum = 0;
+  _sumPrev = 0;
+  _seq = 0;
+  _count = 0;
+  _weighted = 0;
+  _lastUs = 0;
+  _intervalUs = 0;
+  _generation = 0;
+  _seenGeneration = 0;
+  Filter::reset();
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::_addSample(uint16_t sample) {
+  if (N > 1) {
+    uint32_t now = micros();
+    if (_count != 0) {
+      // Correct across the micros() wraparound, the subtraction is modulo 2^32
+      uint32_t interval = now - _lastUs;
+      _intervalUs = (_intervalUs == 0)
+                      ? interval
+                      : (uint32_t)((int32_t)_intervalUs
+                                    + (((int32_t)interval - (int32_t)_intervalUs)
+                                        >> _INTERVAL_SHIFT));
+    }
+    _lastUs = now;
+  }
+  _addFiltered(Filter::apply(sample));
+  if ((_alarm != NULL) && (_count == N)) {
+    // Same as getRawQ6(), but the writer needs no seqlock
+    _alarm->_check((uint16_t)(_sum >> _AVG_SHIFT));
+  }
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::_addFiltered(uint16_t sample) {
+  if (_count < N) {
+    if (_prefill && (_count == 0)) {
+      _fill(sample);
+      return;
+    }
+    ++_count;
+  }
+  // The oldest sample is replaced, and the running sum is updated by the difference
+  // So, the cost does not depend on the window size
+  _weighted = _weighted - (_sum - _samples[_head]) + (uint32_t)(N - 1) * sample;
+  _setSum(_sum - _samples[_head] + sample);
+  _samples[_head] = sample;
+  _head = (uint8_t)((_head + 1) & (N - 1));
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::_fill(uint16_t sample) {
+  // The head stays where it is, all samples are the same
+  for (size_t i = 0; i < N; ++i) {
+    _samples[i] = sample;
+  }
+  // In 32 bits, size_t is 16 bits on AVR
+  _weighted = (uint32_t)sample * ((uint32_t)N * (N - 1) / 2);
+  _setSum((uint32_t)sample << _AVG_SHIFT);
+  _count = N;
+}
+
+template <size_t N, class Filter>
+void ChipTempWindowT<N, Filter>::_setSum(uint32_t sum) {
+  if (_roundRaw(sum >> _AVG_SHIFT) != _roundRaw(_sum >> _AVG_SHIFT)) {
+    ++_generation;
+  }
+  // Nobody reads _sumPrev while _seq is even
+  _sumPrev = _sum;
+  ++_seq;
+  _sum = sum;
+  ++_seq;
+}
+
+// Bodies of ChipTemperatureT members
+
+template <size_t N, class Filter>
+ChipTemperatureT<N, Filter>::ChipTemperatureT() :
+  ChipTempWindowT<N, Filter>(),
+  _stream(NULL)
+{
+}
+
+template <size_t N, class Filter>
+ChipTemperatureT<N, Filter>::ChipTemperatureT(const ChipTempCalPointK& calPoint1,
+                                                const ChipTempCalPointK& calPoint2) :
+  ChipTempWindowT<N, Filter>(calPoint1, calPoint2),
+  _stream(NULL)
+{
+}
+
+template <size_t N, class Filter>
+ChipTemperatureT<N, Filter>::ChipTemperatureT(const ChipTempCalSegment* calTable,
+                                                uint8_t calCount) :
+  ChipTempWindowT<N, Filter>(calTable, calCount),
+  _stream(NULL)
+{
+}
+
+template <size_t N, class Filter>
+void ChipTemperatureT<N, Filter>::loop() {
+  uint16_t sample;
+  if (_isDue() && _acquire(sample)) {
+    _addSample(sample);
+  }
+}
+
+template <size_t N, class Filter>
+void ChipTemperatureT<N, Filter>::setStream(ChipTempSubscriber* stream) {
+  _stream = stream;
+}
+
+template <size_t N, class Filter>
+void ChipTemperatureT<N, Filter>::_addSample(uint16_t sample) {
+  ChipTempWindowT<N, Filter>::_addSample(sample);
+  if (_stream != NULL) {
+    _stream->_onSample(sample);
+  }
+}
+
+template <size_t N, class Filter>
+uint8_t ChipTemperatureT<N, Filter>::acquireBurst(uint8_t n) {
+  if (!_isBlocking()) {
+    return 0;
+  }
+  _prepareHwBurst();
+  for (uint8_t i = 0; i < n; ++i) {
+    uint16_t sample;
+    // Always true in the blocking modes
+    _acquire(sample);
+    _addSample(sample);
+  }
+  return n;
+}
+
+// Bodies of ChipTempSampler inlines
+
+void ChipTempSampler::loop() {
+  uint16_t sample;
+  if (_isDue() && _acquire(sample)) {
+    _publish(sample);
+  }
+}
+
+// Bodies of ChipTempViewT members
+
+template <size_t N, class Filter>
+ChipTempViewT<N, Filter>::ChipTempViewT() :
+  ChipTempWindowT<N, Filter>()
+{
+}
+
+template <size_t N, class Filter>
+ChipTempViewT<N, Filter>::ChipTempViewT(const ChipTempCalPointK& calPoint1,
+                                          const ChipTempCalPointK& calPoint2) :
+  ChipTempWindowT<N, Filter>(calPoint1, calPoint2)
+{
+}
+
+template <size_t N, class Filter>
+ChipTempViewT<N, Filter>::ChipTempViewT(const ChipTempCalSegment* calTable,
+                                          uint8_t calCount) :
+  ChipTempWindowT<N, Filter>(calTable, calCount)
+{
+}
+
+template <size_t N, class Filter>
+void ChipTempViewT<N, Filter>::_onSample(uint16_t sample) {
+  this->_addSample(sample);
 }
 
 #endif // _CHIP_TEMPERATURE_H
@@ -0,0 +1,713 @@
+// Version for AVR chips, common to all of them
+// The chip-specific parts (the multiplexer setup etc.) are in ChipTempHw,
+//  see ChipTemperature_m32u4.h and others
+// The datasheet chapters referenced are of ATmega32U4,
+//  the other chips have the same contents in other chapter numbers
+
+// Not built for the host simulation, see ChipTemperature_sim.cpp
+#ifndef CHIPTEMP_HW_SIM
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include "ChipTemperature.h"
+#include CHIPTEMP_HW_HEADER
+
+// Ownership token of the ADC multiplexer
+// Set after each our reading, cleared by chipTemperatureReleaseMux_AVR()
+static volatile bool chipTemperatureMuxOwned;
+
+// Returns true if the temperature sensor is still selected since our last reading
+// If so, its driver is powered and settled, and the first conversion is the correct one,
+//  so the discarded conversion and delayMicroseconds(2) are not needed
+// The ADMUX/ADCSRB comparison catches analogRead() and other ADC users,
+//  chipTemperatureMuxOwned catches the ones who restored the registers after their work
+static inline bool chipTemperatureIsSelected_AVR() __attribute__((always_inline));
+static inline bool chipTemperatureIsSelected_AVR()
+{
+  return chipTemperatureMuxOwned
+          && ChipTempHw::isSelected()
+          && bit_is_set(ADCSRA, ADEN);
+}
+
+// ADC clock setup for the sensor conversions, see chipTemperatureSetSpeed_AVR()
+// ADPS2..0 prescaler bits, 0 (division by 2, never used by us) means "do not touch the ADC clock"
+static uint8_t chipTemperatureAdps;
+// ADHSM bit value for ADCSRB, only ATmega32U4 has it
+static uint8_t chipTemperatureAdhsm;
+// ADPS2..0 and ADHSM bits of the ADC owner, to be restored after our conversions
+static volatile uint8_t chipTemperatureSavedAdps;
+static volatile uint8_t chipTemperatureSavedAdhsm;
+
+// Selects the ADC clock for the sensor conversions, speed is ChipTempSpeed
+// The ADC clock of analogRead() is not affected, see chipTemperatureSpeedEnter_AVR()
+void chipTemperatureSetSpeed_AVR(uint8_t speed)
+{
+  // The chapter of:
+  //  24.9.2 ADC Control and Status Register A  ADCSRA
+  // the paragraph of:
+  //  Bits 2:0  ADPS2:0: ADC Prescaler Select Bits
+  // says:
+  //  "1 0 0 16", "1 0 1 32", "1 1 1 128"
+  // The chapter of:
+  //  24.9.4 ADC Control and Status Register B  ADCSRB
+  // the paragraph of:
+  //  Bit 7  ADHSM: ADC High Speed Mode
+  //   (ATmega32U4 only, ChipTempHw::HIGH_SPEED_MASK is 0 for the others)
+  // says:
+  //  "Writing this bit to one enables the ADC High Speed mode. Set this bit
+  //   if you wish to convert with an ADC clock frequency higher than 200KHz."
+  switch (speed) {
+  case CHIPTEMP_SPEED_ACCURATE:
+    // 125kHz at 16MHz, 104us per conversion
+    chipTemperatureAdps = _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+    chipTemperatureAdhsm = 0;
+    break;
+  case CHIPTEMP_SPEED_BALANCED:
+    // 500kHz at 16MHz, 26us per conversion
+    chipTemperatureAdps = _BV(ADPS2) | _BV(ADPS0);
+    chipTemperatureAdhsm = ChipTempHw::HIGH_SPEED_MASK;
+    break;
+  case CHIPTEMP_SPEED_FAST:
+    // 1MHz at 16MHz, 13us per conversion
+    chipTemperatureAdps = _BV(ADPS2);
+    chipTemperatureAdhsm = ChipTempHw::HIGH_SPEED_MASK;
+    break;
+  default:
+    chipTemperatureAdps = 0;
+    chipTemperatureAdhsm = 0;
+    break;
+  }
+}
+
+// Switches the ADC clock to the sensor one, remembering the previous one
+// Must be called only when no conversion is in progress
+static inline void chipTemperatureSpeedEnter_AVR() __attribute__((always_inline));
+static inline void chipTemperatureSpeedEnter_AVR()
+{
+  if (chipTemperatureAdps != 0) {
+    chipTemperatureSavedAdps = ADCSRA & (_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0));
+    chipTemperatureSavedAdhsm = ADCSRB & ChipTempHw::HIGH_SPEED_MASK;
+    ADCSRA = (ADCSRA & ~(_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))) | chipTemperatureAdps;
+    if (ChipTempHw::HIGH_SPEED_MASK != 0) {
+      ADCSRB = (ADCSRB & ~ChipTempHw::HIGH_SPEED_MASK) | chipTemperatureAdhsm;
+    }
+  }
+}
+
+// Restores the ADC clock remembered by chipTemperatureSpeedEnter_AVR()
+static inline void chipTemperatureSpeedLeave_AVR() __attribute__((always_inline));
+static inline void chipTemperatureSpeedLeave_AVR()
+{
+  if (chipTemperatureAdps != 0) {
+    ADCSRA = (ADCSRA & ~(_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))) | chipTemperatureSavedAdps;
+    if (ChipTempHw::HIGH_SPEED_MASK != 0) {
+      ADCSRB = (ADCSRB & ~ChipTempHw::HIGH_SPEED_MASK) | chipTemperatureSavedAdhsm;
+    }
+  }
+}
+
+// Must be called by the code which uses the ADC and then restores ADMUX/ADCSRB
+//  to the temperature sensor selection, or disables the ADC
+// analogRead() needs no such call
+void chipTemperatureReleaseMux_AVR()
+{
+  chipTemperatureMuxOwned = false;
+}
+
+// Reads the on-chip temperature sensor as abstract [0..1023] integer
+// The reading is linear, and must be then calibrated to the real temperature
+// As the undocumented "as is" empirical fact, one can treat the value
+//  as Kelvin degrees from absolute zero (-273 C),
+//  though uncalibrated value can give the error by 10C
+// The reading is frequently oscillating by +-1..2
+// Applying the debounce tineout logic (like for buttons,
+//   i.e. wait till the reading is constant for some time)
+//  does not work - the debounce timeout never occurs
+// So, some averaging should be used on the return value of this function
+// The logic is based on analogRead() source, and does not break analogRead()
+// The function only contains delayMicroseconds(2), not delay() or analogs of any kind,
+//  so it supports hard realtime
+uint16_t chipTemperatureReadRaw_AVR()
+{
+  //
+  // ATmega32U4 datasheet, the chapter of:
+  //  24.6.1 Sensor Calibration
+  // says:
+  //  The sensor initial tolerance is large (10C), but its characteristic is linear.
+  //
+  // We are compatible with analogRead() since it will reprogram
+  //  all of the registers we're touching
+  //
+  // We read these twice, and don't want the compiler to get rid of the first reading action
+  //  (it is probably important for the chip)
+  volatile uint8_t low, high;
+  // No conversion is in progress, so the ADC clock can be switched
+  chipTemperatureSpeedEnter_AVR();
+  //
+  // Nobody touched the multiplexer since our last reading - the single conversion is enough
+  // This halves the time of the reading in the common case
+  if (chipTemperatureIsSelected_AVR()) {
+    // See the comments below on ADSC and ADCL/ADCH
+    ADCSRA = ADCSRA | _BV(ADSC);
+    while (bit_is_set(ADCSRA, ADSC));
+    low = ADCL;
+    high = ADCH;
+    chipTemperatureSpeedLeave_AVR();
+    return (high << 8) | low;
+  }
+  //
+  // Connect the temperature sensor as ADC input,
+  //   power the sensor up,
+  //   and set the proper analog reference for it
+  // This is chip-specific, see ChipTempHw::select()
+  //
+  ChipTempHw::select();
+  //
+  // Sensor connected, now start the ADC
+  //
+  // The chapter of:
+  //  24.9.2 ADC Control and Status Register A  ADCSRA
+  // the paragraph of:
+  //  Bit 6  ADSC: ADC Start Conversion
+  // says:
+  //  "In Single Conversion mode, write this bit to one to start each conversion.
+  //   In Free Running mode, write this bit to one to start the first conversion.
+  //   The first conversion after ADSC has been written after the ADC has been enabled,
+  //    or if ADSC is written at the same time as the ADC is enabled,
+  //    will take 25 ADC clock cycles instead of the normal 13.
+  //    This first conversion performs initialization of the ADC.
+  //   ADSC will read as one as long as a conversion is in progress.
+  //   When the conversion is complete, it returns to zero.
+  //   Writing zero to this bit has no effect."
+  // Start the measurement
+  ADCSRA = ADCSRA | _BV(ADSC);
+  // Poll-wait for the measurement to be done (it takes some time)
+  while (bit_is_set(ADCSRA, ADSC));
+  // The chapter of:
+  //  24.9.3 The ADC Data Register  ADCL and ADCH
+  // says:
+  //  "When ADCL is read, the ADC Data Register is not updated until ADCH is read.
+  //  Consequently, if the result is left adjusted and no more than 8 -
+  //  bit precision(7 bit + sign bit for differential input channels) is required, it is
+  //  sufficient to read ADCH. Otherwise, ADCL must be read first, then ADCH."
+  // Read ADCL first
+  low = ADCL;
+  high = ADCH;
+  // The chapter of:
+  //  24.6 Temperature Sensor
+  // says:
+  //  "The temperature sensor and its internal driver are enabled
+  //   when ADMUX value selects the temperature sensor as ADC input.
+  //   The propagation delay of this driver is approximately 2uS.
+  //   Therefore two successive conversions are required.
+  //   The correct temperature measurement will be the second one."
+  //
+  // So, delay for 2us and repeat the ADC measurement
+  //
+  delayMicroseconds(2); // this busy-loops the CPU in a calibrated execution loop
+  // Start the measurement
+  ADCSRA = ADCSRA | _BV(ADSC);
+  // Poll-wait for the measurement to be done
+  while (bit_is_set(ADCSRA, ADSC));
+  // Read and return the result
+  low = ADCL;
+  high = ADCH;
+  chipTemperatureSpeedLeave_AVR();
+  chipTemperatureMuxOwned = true;
+  return (high << 8) | low;
+}
+
+// Prepares the ADC for a burst of chipTemperatureReadRaw_AVR() calls
+// If the sensor is not selected, selecting it also switches the analog reference,
+//  and the datasheet chapter of:
+//  24.5.2 ADC Voltage Reference
+// says:
+//  "The first ADC conversion result after switching reference voltage source
+//   may be inaccurate, and the user is advised to discard this result."
+// chipTemperatureReadRaw_AVR() discards one conversion for the sensor driver anyway,
+//  so one more whole reading is discarded here for the reference,
+//  and then all readings of the burst are the single-conversion ones
+void chipTemperaturePrepareBurst_AVR()
+{
+  if (!chipTemperatureIsSelected_AVR()) {
+    chipTemperatureReadRaw_AVR();
+  }
+}
+
+// Reads the 1.1V bandgap against the reference of the sensor, see ChipTempHw::selectBandgap()
+// Returns 0 on the chips where the reference of the sensor is the bandgap itself
+// The reference is not switched, but the bandgap input must settle after the multiplexer
+//  change, same as the sensor driver, so the first conversion is discarded
+// The sensor is then not selected, and the next chipTemperatureReadRaw_AVR()
+//  selects it again, with its own discarded conversion
+// Must not be called while an async or auto-triggered reading is in progress
+uint16_t chipTemperatureReadBandgap_AVR()
+{
+  if (ChipTempHw::ADMUX_BANDGAP == 0) {
+    return 0;
+  }
+  volatile uint8_t low, high;
+  chipTemperatureSpeedEnter_AVR();
+  ChipTempHw::selectBandgap();
+  // See chipTemperatureReadRaw_AVR() for the datasheet on ADSC and ADCL/ADCH
+  ADCSRA = ADCSRA | _BV(ADSC);
+  while (bit_is_set(ADCSRA, ADSC));
+  low = ADCL;
+  high = ADCH;
+  ADCSRA = ADCSRA | _BV(ADSC);
+  while (bit_is_set(ADCSRA, ADSC));
+  low = ADCL;
+  high = ADCH;
+  chipTemperatureSpeedLeave_AVR();
+  chipTemperatureMuxOwned = false;
+  return (high << 8) | low;
+}
+
+bool chipTemperatureHasBandgap_AVR()
+{
+  return ChipTempHw::ADMUX_BANDGAP != 0;
+}
+
+// EEPROM access of ChipTempStore, by avr-libc
+// eeprom_update_block() only writes the bytes which differ, saving the erase cycles
+void chipTemperatureEepromRead_AVR(uint16_t address, uint8_t* data, uint8_t size)
+{
+  eeprom_read_block(data, (const void*)(uintptr_t)address, size);
+}
+
+void chipTemperatureEepromWrite_AVR(uint16_t address, const uint8_t* data, uint8_t size)
+{
+  eeprom_update_block(data, (void*)(uintptr_t)address, size);
+}
+
+// Asynchronous (interrupt-driven) version of the same reading
+
+// States of the ADC_vect ISR state machine
+// The reading is the same 2 successive conversions as in chipTemperatureReadRaw_AVR(),
+//  but the CPU is not polling ADSC, the ISR advances the state instead
+#define CHIPTEMP_ASYNC_IDLE     0 // no conversions in progress, no result
+#define CHIPTEMP_ASYNC_DISCARD  1 // first conversion in progress, its result will be thrown away
+#define CHIPTEMP_ASYNC_MEASURE  2 // second conversion in progress, its result is the reading
+#define CHIPTEMP_ASYNC_DONE     3 // the reading is in chipTemperatureAsyncReading
+// Sleeping states, the conversions are started by entering the ADC Noise Reduction mode
+// After CHIPTEMP_SLEEP_MEASURE, the state is CHIPTEMP_ASYNC_DONE
+#define CHIPTEMP_SLEEP_DISCARD  4 // first conversion, its result will be thrown away
+#define CHIPTEMP_SLEEP_MEASURE  5 // second conversion, its result is the reading
+// Auto-triggered states, the conversions are started by the timer and not by the code
+#define CHIPTEMP_AUTO_DISCARD   6 // first conversion after the multiplexer setup is pending
+#define CHIPTEMP_AUTO_MEASURE   7 // each conversion is the reading
+
+// Written by the ISR, read by chipTemperatureReadRawAsync_AVR()
+static volatile uint8_t chipTemperatureAsyncState = CHIPTEMP_ASYNC_IDLE;
+// Only valid in CHIPTEMP_ASYNC_DONE state
+// No tearing on reading it non-atomically in CHIPTEMP_ASYNC_DONE state:
+//  the ISR does not touch it until the next conversion pair is started
+//  from the foreground code
+static volatile uint16_t chipTemperatureAsyncReading;
+// The async reading in progress (or done) is the bandgap one,
+//  see chipTemperatureReadBandgapAsync_AVR()
+// Written only by the foreground code while no reading is in progress
+static volatile bool chipTemperatureAsyncBandgap;
+// The auto-triggered readings, a single-producer single-consumer ring:
+//  the ISR is the only writer of the head, chipTemperatureReadRawAuto_AVR() of the tail
+// The 8-bit indices are read and written atomically by the AVR,
+//  and the slot of the head is never the one being read at the tail,
+//  so neither side needs cli(), and the loop() slower than the timer loses no readings
+// Must be a power of 2
+#define CHIPTEMP_AUTO_RING_SIZE 8
+static volatile uint16_t chipTemperatureAutoRing[CHIPTEMP_AUTO_RING_SIZE];
+static volatile uint8_t chipTemperatureAutoHead;
+static volatile uint8_t chipTemperatureAutoTail;
+// Timer interrupt flag which triggers the auto-triggered conversions
+// The ISR must clear it, since the trigger is its rising edge
+static volatile uint8_t* chipTemperatureAutoFlagReg;
+static uint8_t chipTemperatureAutoFlag;
+
+// Adds the auto-triggered reading to the ring, called by the only producer
+// If the ring is full, the reading is dropped, the older ones are not overwritten:
+//  overwriting would move the tail, which belongs to the consumer
+static inline void chipTemperatureAutoPush_AVR(uint16_t reading) __attribute__((always_inline));
+static inline void chipTemperatureAutoPush_AVR(uint16_t reading)
+{
+  uint8_t head = chipTemperatureAutoHead;
+  uint8_t next = (head + 1) & (CHIPTEMP_AUTO_RING_SIZE - 1);
+  if (next != chipTemperatureAutoTail) {
+    // The slot first, and only then the index which publishes it
+    chipTemperatureAutoRing[head] = reading;
+    chipTemperatureAutoHead = next;
+  }
+}
+
+// Returns true if the multiplexer still selects the input of the background reading,
+//  the sensor or the bandgap one
+static inline bool chipTemperatureAsyncSelected_AVR() __attribute__((always_inline));
+static inline bool chipTemperatureAsyncSelected_AVR()
+{
+  return chipTemperatureAsyncBandgap ? ChipTempHw::isBandgapSelected() : ChipTempHw::isSelected();
+}
+
+// Non-blocking version of chipTemperatureReadRaw_AVR()
+// If the previously started reading is done - stores it to reading and returns true
+// If no reading is in progress - starts the new one, and returns immediately
+// The reading just collected only starts the next one if restart is set,
+//  otherwise the ADC stays idle, and the next call starts it
+// So, the caller just calls this once per loop() and gets a new reading each 2nd-3rd call
+// The reading will be dropped (and restarted by the next call)
+//  if analogRead() reprogrammed the ADC multiplexer during the conversions,
+//  but that analogRead() itself gets our sensor conversion as its result,
+//  so chipTemperatureAnalogRead_AVR() must be used instead of it
+bool chipTemperatureReadRawAsync_AVR(uint16_t& reading, bool restart)
+{
+  bool done = false;
+  if (chipTemperatureAsyncState == CHIPTEMP_ASYNC_DONE) {
+    // The bandgap reading left by chipTemperatureReadBandgapAsync_AVR() is dropped
+    if (!chipTemperatureAsyncBandgap) {
+      reading = chipTemperatureAsyncReading;
+      done = true;
+    }
+    chipTemperatureAsyncState = CHIPTEMP_ASYNC_IDLE;
+  }
+  if ((chipTemperatureAsyncState == CHIPTEMP_ASYNC_IDLE) && (restart || !done)) {
+    chipTemperatureAsyncBandgap = false;
+    if (chipTemperatureIsSelected_AVR()) {
+      // No need in the discarded conversion
+      chipTemperatureAsyncState = CHIPTEMP_ASYNC_MEASURE;
+    } else {
+      ChipTempHw::select();
+      chipTemperatureAsyncState = CHIPTEMP_ASYNC_DISCARD;
+    }
+    chipTemperatureSpeedEnter_AVR();
+    // ADIE: ADC Interrupt Enable
+    // Start the first measurement with interrupt on its completion
+    ADCSRA = ADCSRA | _BV(ADIE) | _BV(ADSC);
+  }
+  return done;
+}
+
+// Same as chipTemperatureReadRawAsync_AVR(), but for the bandgap,
+//  see chipTemperatureReadBandgap_AVR()
+// The sensor reading left done is dropped, and the bandgap one is started instead
+// Never starts the next reading, the next chipTemperatureReadRawAsync_AVR() call
+//  selects the sensor again, with its own discarded conversion
+bool chipTemperatureReadBandgapAsync_AVR(uint16_t& reading)
+{
+  if (ChipTempHw::ADMUX_BANDGAP == 0) {
+    reading = 0;
+    return true;
+  }
+  bool done = false;
+  if (chipTemperatureAsyncState == CHIPTEMP_ASYNC_DONE) {
+    if (chipTemperatureAsyncBandgap) {
+      reading = chipTemperatureAsyncReading;
+      done = true;
+    }
+    chipTemperatureAsyncState = CHIPTEMP_ASYNC_IDLE;
+  }
+  if ((chipTemperatureAsyncState == CHIPTEMP_ASYNC_IDLE) && !done) {
+    chipTemperatureAsyncBandgap = true;
+    // The sensor is deselected, and its driver must settle again after this
+    chipTemperatureMuxOwned = false;
+    ChipTempHw::selectBandgap();
+    chipTemperatureAsyncState = CHIPTEMP_ASYNC_DISCARD;
+    chipTemperatureSpeedEnter_AVR();
+    ADCSRA = ADCSRA | _BV(ADIE) | _BV(ADSC);
+  }
+  return done;
+}
+
+// Same as chipTemperatureReadRaw_AVR(), but the CPU sleeps in ADC Noise Reduction mode
+//  during the conversions instead of poll-waiting them
+// This saves the power, and the conversions are less noisy without the CPU clock
+// While sleeping, clkIO is stopped, so are Timer0 and millis(),
+//  for ~104us per conversion with the default ADC clock
+// Enables the interrupts, since the ADC interrupt must wake the CPU up
+// The sleep mode of the sketch is restored on return, same as SREG
+uint16_t chipTemperatureReadRawSleep_AVR()
+{
+  uint8_t sreg = SREG;
+  uint16_t reading;
+  cli();
+  // The SM bits of SMCR (MCUCR on ATtiny85), as avr-libc names them for set_sleep_mode()
+  uint8_t sleepMode = _SLEEP_CONTROL_REG & _SLEEP_MODE_MASK;
+  set_sleep_mode(SLEEP_MODE_ADC);
+  chipTemperatureAsyncState = CHIPTEMP_ASYNC_IDLE;
+  chipTemperatureAsyncBandgap = false;
+  while (chipTemperatureAsyncState != CHIPTEMP_ASYNC_DONE) {
+    if (chipTemperatureAsyncState == CHIPTEMP_ASYNC_IDLE) {
+      // Either the first pass, or the ISR dropped the reading for analogRead() called from
+      //  some other ISR
+      if (chipTemperatureIsSelected_AVR()) {
+        chipTemperatureAsyncState = CHIPTEMP_SLEEP_MEASURE;
+      } else {
+        ChipTempHw::select();
+        chipTemperatureAsyncState = CHIPTEMP_SLEEP_DISCARD;
+      }
+      chipTemperatureSpeedEnter_AVR();
+      ADCSRA = ADCSRA | _BV(ADIE);
+    }
+    // The chapter of:
+    //  24.7.1 ADC Noise Canceler
+    // says:
+    //  "a. Make sure that the ADC is enabled and is not busy converting.
+    //      Single Conversion mode must be selected and the ADC conversion complete
+    //      interrupt must be enabled.
+    //   b. Enter ADC Noise Reduction mode (or Idle mode).
+    //      The ADC will start a conversion once the CPU has been halted.
+    //   c. If no other interrupts occur before the ADC conversion completes,
+    //      the ADC interrupt will wake up the CPU and execute the ADC Conversion
+    //      Complete interrupt routine. If another interrupt wakes up the CPU
+    //      before the ADC conversion completes, that interrupt will be executed,
+    //      and an ADC Conversion Complete interrupt request will be generated
+    //      when the ADC conversion completes."
+    if (bit_is_set(ADCSRA, ADSC) || bit_is_set(ADCSRA, ADIF)) {
+      // Woken up by another interrupt before the conversion end,
+      //  or the ADC interrupt is pending
+      // Sleeping again would start one more conversion, so just let it complete
+      sei();
+      while (bit_is_set(ADCSRA, ADSC));
+      cli();
+    } else {
+      // The instruction after sei() is executed before any pending interrupt,
+      //  so the wakeup cannot be lost between the check above and the sleep
+      sleep_enable();
+      sei();
+      sleep_cpu();
+      sleep_disable();
+      cli();
+    }
+  }
+  reading = chipTemperatureAsyncReading;
+  chipTemperatureAsyncState = CHIPTEMP_ASYNC_IDLE;
+  _SLEEP_CONTROL_REG = (_SLEEP_CONTROL_REG & ~_SLEEP_MODE_MASK) | sleepMode;
+  SREG = sreg;
+  return reading;
+}
+
+// Starts the conversions auto-triggered by a timer compare match
+// mode is CHIPTEMP_MODE_TIMER0 or CHIPTEMP_MODE_TIMER1
+// The multiplexer is set up only once here, and the sensor driver stays powered,
+//  so only the very first conversion is discarded
+// The sample rate is the one of the timer, with no CPU involvement except the ISR
+// The ADC cannot be used by analogRead() until chipTemperatureStopAuto_AVR()
+void chipTemperatureStartAuto_AVR(uint8_t mode)
+{
+  // The trigger source is chip-specific
+  uint8_t adts;
+  ChipTempHw::autoTrigger(mode, adts, chipTemperatureAutoFlagReg, chipTemperatureAutoFlag);
+  // Finish the pending non-auto reading if any, it will not be collected anyway
+  ADCSRA = ADCSRA & ~(_BV(ADIE) | _BV(ADATE));
+  while (bit_is_set(ADCSRA, ADSC));
+  if ((chipTemperatureAsyncState == CHIPTEMP_ASYNC_DISCARD)
+        || (chipTemperatureAsyncState == CHIPTEMP_ASYNC_MEASURE)) {
+    chipTemperatureSpeedLeave_AVR();
+  }
+  // The ISR is disabled, so the ring can be emptied from here
+  chipTemperatureAutoHead = 0;
+  chipTemperatureAutoTail = 0;
+  chipTemperatureAsyncBandgap = false;
+  if (chipTemperatureIsSelected_AVR()) {
+    chipTemperatureAsyncState = CHIPTEMP_AUTO_MEASURE;
+  } else {
+    chipTemperatureAsyncState = CHIPTEMP_AUTO_DISCARD;
+    ChipTempHw::select();
+  }
+  ADCSRB = (ADCSRB & ~ChipTempHw::ADTS_MASK) | adts;
+  // Kept till chipTemperatureStopAuto_AVR()
+  chipTemperatureSpeedEnter_AVR();
+  // Clear the stale trigger flag, or the first rising edge will never come
+  *chipTemperatureAutoFlagReg = chipTemperatureAutoFlag;
+  // ADATE: ADC Auto Trigger Enable
+  ADCSRA = ADCSRA | _BV(ADATE) | _BV(ADIE);
+}
+
+// Stops the conversions started by chipTemperatureStartAuto_AVR()
+// The ADC is then again usable by analogRead()
+void chipTemperatureStopAuto_AVR()
+{
+  ADCSRA = ADCSRA & ~(_BV(ADIE) | _BV(ADATE));
+  ADCSRB = ADCSRB & ~ChipTempHw::ADTS_MASK;
+  // The conversion in progress, if any, completes without the ISR
+  while (bit_is_set(ADCSRA, ADSC));
+  chipTemperatureSpeedLeave_AVR();
+  chipTemperatureAsyncState = CHIPTEMP_ASYNC_IDLE;
+}
+
+// Collects the reading of the auto-triggered conversions
+// Returns true and stores the oldest reading not collected yet, or false if there is none
+// Call it until it returns false to get all readings done since the last time
+// Does not disable the interrupts, see chipTemperatureAutoRing
+bool chipTemperatureReadRawAuto_AVR(uint16_t& reading)
+{
+  uint8_t tail = chipTemperatureAutoTail;
+  if (tail == chipTemperatureAutoHead) {
+    return false;
+  }
+  // The slot first, and only then the index which frees it for the ISR
+  reading = chipTemperatureAutoRing[tail];
+  chipTemperatureAutoTail = (tail + 1) & (CHIPTEMP_AUTO_RING_SIZE - 1);
+  return true;
+}
+
+// Drops all the auto-triggered readings not collected yet, so the next one is fresh
+// Same as collecting them all: only the tail is moved, which is the consumer side,
+//  so no cli() is needed either
+void chipTemperatureFlushAuto_AVR()
+{
+  chipTemperatureAutoTail = chipTemperatureAutoHead;
+}
+
+// ADC arbitration with analogRead(), see chipTemperatureAnalogRead_AVR()
+
+// Takes the ADC away from the background sensor readings
+// The background reading in progress is either completed (if its conversion is done),
+//  or dropped to be restarted by the next loop()
+// Returns true if the auto-triggered mode was running, and must be resumed
+// refChanged is set if the sensor (and so its internal reference) was selected
+static bool chipTemperatureAdcSuspend_AVR(bool& refChanged)
+{
+  bool autoMode = false;
+  uint8_t sreg = SREG;
+  // The ISR also writes ADCSRA, so the read-modify-write must not be interrupted
+  cli();
+  // No more ISR calls, and no more auto-triggered conversions
+  // Writing ADIF back as 1 would clear it, and lose the pending result
+  ADCSRA = ADCSRA & ~(_BV(ADIE) | _BV(ADATE) | _BV(ADIF));
+  SREG = sreg;
+  // The conversion in progress, if any, completes without the ISR
+  // The ISR cannot fire any more, so the other interrupts are not masked
+  //  for this wait, up to 25 ADC clocks (~200us at F_CPU/128) of the first conversion
+  while (bit_is_set(ADCSRA, ADSC));
+  cli();
+  uint8_t state = chipTemperatureAsyncState;
+  // The bandgap reading uses the same internal reference as the sensor
+  refChanged = ChipTempHw::isSelected() || ChipTempHw::isBandgapSelected();
+  if (bit_is_set(ADCSRA, ADIF)) {
+    // The conversion is complete, but the ISR has not collected it
+    // Read ADCL first, see the datasheet quote in chipTemperatureReadRaw_AVR()
+    uint8_t low = ADCL;
+    uint8_t high = ADCH;
+    bool selected = chipTemperatureAsyncSelected_AVR();
+    if (selected && (state == CHIPTEMP_ASYNC_MEASURE)) {
+      chipTemperatureAsyncReading = (high << 8) | low;
+      chipTemperatureMuxOwned = !chipTemperatureAsyncBandgap;
+      chipTemperatureSpeedLeave_AVR();
+      state = CHIPTEMP_ASYNC_DONE;
+    } else if (selected && (state == CHIPTEMP_AUTO_MEASURE)) {
+      // The ISR is disabled, so this is the only producer now
+      chipTemperatureAutoPush_AVR((high << 8) | low);
+    }
+    // ADIF is cleared by writing 1 to it
+    ADCSRA = ADCSRA | _BV(ADIF);
+  }
+  if (state >= CHIPTEMP_AUTO_DISCARD) {
+    // The sensor ADC clock was kept by the auto-triggered mode
+    chipTemperatureSpeedLeave_AVR();
+    autoMode = true;
+  } else if ((state != CHIPTEMP_ASYNC_IDLE) && (state != CHIPTEMP_ASYNC_DONE)) {
+    // The async or sleeping reading is dropped, see the ISR on the multiplexer mismatch
+    chipTemperatureSpeedLeave_AVR();
+    state = CHIPTEMP_ASYNC_IDLE;
+  }
+  chipTemperatureAsyncState = state;
+  SREG = sreg;
+  return autoMode;
+}
+
+// Gives the ADC back to the background sensor readings after chipTemperatureAdcSuspend_AVR()
+static void chipTemperatureAdcResume_AVR(bool autoMode)
+{
+  // analogRead() reprogrammed the multiplexer
+  chipTemperatureMuxOwned = false;
+  if (autoMode) {
+    // Same as chipTemperatureStartAuto_AVR(), the trigger source is still in ADCSRB
+    uint8_t sreg = SREG;
+    cli();
+    chipTemperatureAsyncState = CHIPTEMP_AUTO_DISCARD;
+    ChipTempHw::select();
+    chipTemperatureSpeedEnter_AVR();
+    *chipTemperatureAutoFlagReg = chipTemperatureAutoFlag;
+    ADCSRA = ADCSRA | _BV(ADATE) | _BV(ADIE);
+    SREG = sreg;
+  }
+}
+
+// Does analogRead() for each of count pins, storing the results to values,
+//  without any collisions with the background sensor readings
+// All the pins are read in a single ADC ownership, so the analog reference
+//  is switched away from the sensor one and back only once for the whole group
+// If the sensor reference was selected, the first conversion is discarded,
+//  since the AREF pin capacitor needs time to settle on the new reference
+// Must not be called from the ISRs
+void chipTemperatureAnalogRead_AVR(const uint8_t* pins, uint16_t* values, uint8_t count)
+{
+  bool refChanged;
+  bool autoMode = chipTemperatureAdcSuspend_AVR(refChanged);
+  if (refChanged && (count > 0)) {
+    analogRead(pins[0]);
+  }
+  for (uint8_t i = 0; i < count; ++i) {
+    values[i] = analogRead(pins[i]);
+  }
+  chipTemperatureAdcResume_AVR(autoMode);
+}
+
+// Opt-in, see CHIPTEMP_USE_ADC_ISR in ChipTemperature.h,
+//  so the blocking-only sketches can have their own ADC_vect handler
+#ifdef CHIPTEMP_USE_ADC_ISR
+ISR(ADC_vect)
+{
+  // Read ADCL first, see the datasheet quote in chipTemperatureReadRaw_AVR()
+  uint8_t low = ADCL;
+  uint8_t high = ADCH;
+  uint8_t state = chipTemperatureAsyncState;
+  if (state >= CHIPTEMP_AUTO_DISCARD) {
+    // The chapter of:
+    //  24.4 Starting a Conversion
+    // says:
+    //  "Note that the Interrupt Flag must be cleared in order to trigger
+    //   a new conversion at the next interrupt event."
+    *chipTemperatureAutoFlagReg = chipTemperatureAutoFlag;
+  }
+  // analogRead() reprogrammed the multiplexer (or even started its own conversion)
+  if (!chipTemperatureAsyncSelected_AVR()) {
+    chipTemperatureMuxOwned = false;
+    if (state >= CHIPTEMP_AUTO_DISCARD) {
+      // Take the ADC back, and let the sensor driver settle once again
+      ChipTempHw::select();
+      chipTemperatureAsyncState = CHIPTEMP_AUTO_DISCARD;
+    } else {
+      // Drop the reading, the foreground code will restart it
+      ADCSRA = ADCSRA & ~_BV(ADIE);
+      chipTemperatureSpeedLeave_AVR();
+      chipTemperatureAsyncState = CHIPTEMP_ASYNC_IDLE;
+    }
+    return;
+  }
+  if (state == CHIPTEMP_ASYNC_DISCARD) {
+    // The first conversion took 13..25 ADC clocks, which is far beyond
+    //  the 2us propagation delay of the sensor driver,
+    //  so no delayMicroseconds(2) is needed before the second one
+    chipTemperatureAsyncState = CHIPTEMP_ASYNC_MEASURE;
+    ADCSRA = ADCSRA | _BV(ADSC);
+  } else if (state == CHIPTEMP_SLEEP_DISCARD) {
+    // Same, but the second conversion is started by the next sleep
+    chipTemperatureAsyncState = CHIPTEMP_SLEEP_MEASURE;
+  } else if ((state == CHIPTEMP_ASYNC_MEASURE) || (state == CHIPTEMP_SLEEP_MEASURE)) {
+    chipTemperatureAsyncReading = (high << 8) | low;
+    chipTemperatureAsyncState = CHIPTEMP_ASYNC_DONE;
+    // After the bandgap reading, the sensor driver must settle again
+    chipTemperatureMuxOwned = !chipTemperatureAsyncBandgap;
+    // Do not fire on analogRead() conversions
+    ADCSRA = ADCSRA & ~_BV(ADIE);
+    chipTemperatureSpeedLeave_AVR();
+  } else if (state == CHIPTEMP_AUTO_DISCARD) {
+    chipTemperatureAsyncState = CHIPTEMP_AUTO_MEASURE;
+    chipTemperatureMuxOwned = true;
+  } else if (state == CHIPTEMP_AUTO_MEASURE) {
+    chipTemperatureAutoPush_AVR((high << 8) | low);
+  }
+}
+#endif // CHIPTEMP_USE_ADC_ISR
+
+#endif // CHIPTEMP_HW_SIM
@@ -0,0 +1,110 @@
+// ChipTemperature - filter stages for the samples, see ChipTemperatureT
+// Included by ChipTemperature.h, not to be included directly
+#ifndef _CHIP_TEMPERATURE_FILTER_H
+#define _CHIP_TEMPERATURE_FILTER_H
+
+// Each stage is a class with:
+//  - uint16_t apply(uint16_t sample), which takes the new Q10.6 sample
+//    and returns the filtered one
+//  - void reset(), which forgets all previous samples
+// The stages are applied to each new sample before the boxcar averaging
+//  of ChipTemperatureT, and can be combined by ChipTempFilterChain
+// All is resolved at compile time, so the sketch only pays the RAM and flash
+//  for the stages it uses
+
+// No filtering, the default
+struct ChipTempFilterNone {
+  uint16_t apply(uint16_t sample) { return sample; }
+  void reset() {}
+};
+
+// Exponential moving average: y += (x - y) / 2^SHIFT
+// 2 bytes of state, no multiplies or divisions, and the latency is lesser
+//  than the one of the boxcar with the same noise reduction
+// The time constant is ~2^SHIFT samples
+// Use ChipTemperatureT<1, ChipTempFilterEmaT<k>> to have the EMA only
+template <uint8_t SHIFT>
+class ChipTempFilterEmaT {
+  static_assert((SHIFT > 0) && (SHIFT <= 8), "ChipTempFilterEmaT: SHIFT must be 1 to 8");
+public:
+  ChipTempFilterEmaT() : _value(0) {}
+  uint16_t apply(uint16_t sample) {
+    if (_value == 0) {
+      // The first sample, the hardware never reads 0 for the sensor
+      // Start at it, and not at 0, not to wait for the convergence
+      _value = sample;
+    } else {
+      // The difference is signed, and needs 17 bits
+      // The step is rounded to nearest: the bare arithmetic shift rounds towards
+      //  minus infinity, and the value would stick up to 2^SHIFT - 1 Q10.6 units
+      //  below a steady input
+      // Rounded, the value settles within 2^(SHIFT-1) units of the input, to either side,
+      //  which is within a half of the hardware LSB for SHIFT up to 6
+      _value = (uint16_t)((int32_t)_value
+                  + ((((int32_t)sample - (int32_t)_value) + ((int32_t)1 << (SHIFT - 1))) >> SHIFT));
+    }
+    return _value;
+  }
+  void reset() { _value = 0; }
+private: // state fields
+  // Current filter output, Q10.6, or 0 before the first sample
+  uint16_t _value;
+};
+
+// Median of the last K samples, K is odd and up to 7
+// Rejects single spikes (like the 2 LSB ones of the ADC) instead of spreading them
+//  over the averaging window
+// Before K samples arrive, the median of the available ones is returned
+template <uint8_t K>
+class ChipTempFilterMedianT {
+  static_assert((K >= 3) && (K <= 7) && ((K & 1) != 0), "ChipTempFilterMedianT: K must be 3, 5 or 7");
+public:
+  ChipTempFilterMedianT() { reset(); }
+  uint16_t apply(uint16_t sample) {
+    _window[_head] = sample;
+    _head = (_head + 1 < K) ? (uint8_t)(_head + 1) : 0;
+    if (_count < K) {
+      ++_count;
+    }
+    // Insertion sort of a copy, the cheapest one for such a tiny K
+    uint16_t sorted[K];
+    for (uint8_t i = 0; i < _count; ++i) {
+      uint16_t v = _window[i];
+      uint8_t j = i;
+      for (; (j > 0) && (sorted[j - 1] > v); --j) {
+        sorted[j] = sorted[j - 1];
+      }
+      sorted[j] = v;
+    }
+    return sorted[_count >> 1];
+  }
+  void reset() {
+    _head = 0;
+    _count = 0;
+  }
+private: // state fields
+  // Last K samples, a ring buffer, the order does not matter for the median
+  uint16_t _window[K];
+  // Index of the next sample to be overwritten
+  uint8_t _head;
+  // Number of valid samples in _window
+  uint8_t _count;
+};
+
+// Two stages one after another, First is applied first
+// Nest the chains for more stages:
+//  ChipTempFilterChain<ChipTempFilterMedianT<3>, ChipTempFilterEmaT<3>>
+template <class First, class Second>
+class ChipTempFilterChain {
+public:
+  uint16_t apply(uint16_t sample) { return _second.apply(_first.apply(sample)); }
+  void reset() {
+    _first.reset();
+    _second.reset();
+  }
+private: // state fields
+  First _first;
+  Second _second;
+};
+
+#endif // _CHIP_TEMPERATURE_FILTER_H
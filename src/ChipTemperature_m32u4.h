@@ -0,0 +1,105 @@
+// ChipTemperature - hardware specifics of ATmega32U4 (Arduino Leonardo, Micro etc)
+// Included by ChipTemperature.h, not to be included directly
+#ifndef _CHIP_TEMPERATURE_M32U4_H
+#define _CHIP_TEMPERATURE_M32U4_H
+
+// Hardware traits for ChipTemperature_avr.cpp
+// All members are compile-time constants or always_inline register accesses,
+//  so the common code is the same as if written for this chip only
+struct ChipTempHw_m32U4 {
+  // ADMUX value which selects the temperature sensor and its analog reference:
+  //  REFS1..0 is 0b11 -> internal 2.56V voltage for ref,
+  //  ADLAR (left-adjust result) is 0,
+  //  MUX4..0 is 0b00111
+  // See select() below for the datasheet references
+  static const uint8_t ADMUX_SENSOR = _BV(REFS1) | _BV(REFS0) | 0x07;
+  // ADHSM: ADC High Speed Mode bit of ADCSRB
+  static const uint8_t HIGH_SPEED_MASK = _BV(ADHSM);
+  // ADTS3..0: ADC Auto Trigger Source bits of ADCSRB
+  static const uint8_t ADTS_MASK = _BV(ADTS3) | _BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0);
+  // ADMUX value which selects the 1.1V bandgap against the same 2.56V reference,
+  //  MUX5..0 is 0b011110, see selectBandgap()
+  static const uint8_t ADMUX_BANDGAP = _BV(REFS1) | _BV(REFS0) | 0x1E;
+
+  // Connects the temperature sensor as ADC input,
+  //   powers the sensor up,
+  //   and sets the proper analog reference for it
+  static inline void select() __attribute__((always_inline)) {
+    // The chapter of:
+    //  24.6 Temperature Sensor
+    // says:
+    //  "The internal 2.56V voltage reference must also be selected
+    //   for the ADC voltage reference source in he temperature sensor measurement."
+    // The chapter of:
+    //  24.9.1 ADC Multiplexer Selection Register  ADMUX
+    // says for REFS1:0:
+    //  "1 1 Internal 2.56V Voltage Reference with external capacitor on AREF pin"
+    // - and Leonardo has the capacitor,
+    //   so does Iskra Neo (Russian clone of Leonardo with MUCH improved power supply chips)
+    // Same chapter, the paragraph of:
+    //  Bits 4:0  MUX4:0: Analog Channel Selection Bits
+    // says for MUX5..0:
+    //  100111 Temperature Sensor
+    ADMUX = ADMUX_SENSOR;
+    // The chapter of:
+    //  24.9.4 ADC Control and Status Register B  ADCSRB
+    // the paragraph of:
+    //  Bit 5  MUX5: Analog Channel Additional Selection Bits
+    // says:
+    //  "This bit make part of MUX5:0 bits of ADRCSRB and ADMUX register,
+    //  that select the combination of analog inputs connected to the ADC
+    //  (including differential amplifier configuration)."
+    // So, set MUX5 to 1 to get 0b100111
+    ADCSRB = ADCSRB | _BV(MUX5);
+  }
+
+  // Connects the 1.1V bandgap as ADC input, keeping the 2.56V reference of the sensor
+  // The 2.56V reference is the bandgap amplified, so the reading tracks
+  //  the drift of that amplification, see chipTemperatureReadBandgap_AVR()
+  static inline void selectBandgap() __attribute__((always_inline)) {
+    // The chapter of:
+    //  24.9.1 ADC Multiplexer Selection Register  ADMUX
+    // the paragraph of:
+    //  Bits 4:0  MUX4:0: Analog Channel Selection Bits
+    // says for MUX5..0:
+    //  011110 1.1V (VBand Gap)
+    ADMUX = ADMUX_BANDGAP;
+    ADCSRB = ADCSRB & ~_BV(MUX5);
+  }
+
+  // Returns true if the multiplexer selects the temperature sensor, as select() does it
+  static inline bool isSelected() __attribute__((always_inline)) {
+    return (ADMUX == ADMUX_SENSOR) && bit_is_set(ADCSRB, MUX5);
+  }
+
+  // Returns true if the multiplexer selects the bandgap, as selectBandgap() does it
+  static inline bool isBandgapSelected() __attribute__((always_inline)) {
+    return (ADMUX == ADMUX_BANDGAP) && bit_is_clear(ADCSRB, MUX5);
+  }
+
+  // Provides the ADTS3..0 value and the timer interrupt flag for the auto-triggered mode
+  static inline void autoTrigger(uint8_t mode, uint8_t& adts,
+                                  volatile uint8_t*& flagReg, uint8_t& flag)
+                                  __attribute__((always_inline)) {
+    // The chapter of:
+    //  24.9.4 ADC Control and Status Register B  ADCSRB
+    // the paragraph of:
+    //  Bit 3:0  ADTS3:0: ADC Auto Trigger Source
+    // says:
+    //  "0011 Timer/Counter0 Compare Match"
+    //  "0101 Timer/Counter1 Compare Match B"
+    if (mode == CHIPTEMP_MODE_TIMER1) {
+      adts = _BV(ADTS2) | _BV(ADTS0);
+      flagReg = &TIFR1;
+      flag = _BV(OCF1B);
+    } else {
+      adts = _BV(ADTS1) | _BV(ADTS0);
+      flagReg = &TIFR0;
+      flag = _BV(OCF0A);
+    }
+  }
+};
+
+typedef ChipTempHw_m32U4 ChipTempHw;
+
+#endif // _CHIP_TEMPERATURE_M32U4_H
@@ -0,0 +1,221 @@
+// Version for the host simulation, selected by CHIPTEMP_HW_SIM
+// Implements the same hardware readers as ChipTemperature_avr.cpp,
+//  but the readings come from the trace or the noise generator of ChipTemperature_sim.h
+// The async mode is simulated as on the hardware: the reading started by one call
+//  is collected by the next one
+
+// Only built for the host simulation, see ChipTemperature_avr.cpp for the real one
+#ifdef CHIPTEMP_HW_SIM
+
+#include "ChipTemperature.h"
+
+// The trace, if any, see chipTemperatureSimSetTrace()
+static const uint16_t* chipTemperatureSimTrace;
+static size_t chipTemperatureSimTraceCount;
+static size_t chipTemperatureSimTraceIndex;
+// The noise generator, see chipTemperatureSimSetNoise()
+static uint16_t chipTemperatureSimReading = 350;
+static uint8_t chipTemperatureSimNoise = 2;
+static uint32_t chipTemperatureSimSeed = 1;
+// The simulated clock
+static unsigned long chipTemperatureSimMicros;
+// The simulated EEPROM, erased (0xFF) initially, see chipTemperatureSimEeprom()
+static uint8_t chipTemperatureSimEepromBytes[CHIPTEMP_SIM_EEPROM_SIZE];
+static bool chipTemperatureSimEepromErased;
+// The bandgap reading, and so the reference drift, see chipTemperatureSimSetBandgap()
+static uint16_t chipTemperatureSimBandgap = CHIPTEMP_BANDGAP_NOMINAL;
+// Statistics
+static uint32_t chipTemperatureSimReadings;
+// The async reading was started by the previous call, and is not collected yet
+static bool chipTemperatureSimAsyncStarted;
+// The auto-triggered mode is running
+static bool chipTemperatureSimAuto;
+
+unsigned long micros()
+{
+  return chipTemperatureSimMicros;
+}
+
+void chipTemperatureSimSetTrace(const uint16_t* readings, size_t count)
+{
+  chipTemperatureSimTrace = readings;
+  chipTemperatureSimTraceCount = count;
+  chipTemperatureSimTraceIndex = 0;
+}
+
+void chipTemperatureSimSetNoise(uint16_t reading, uint8_t noise, uint32_t seed)
+{
+  chipTemperatureSimTrace = NULL;
+  chipTemperatureSimTraceCount = 0;
+  chipTemperatureSimReading = reading;
+  chipTemperatureSimNoise = noise;
+  chipTemperatureSimSeed = (seed != 0) ? seed : 1;
+}
+
+void chipTemperatureSimAdvanceMicros(uint32_t us)
+{
+  chipTemperatureSimMicros += us;
+}
+
+void chipTemperatureSimSetBandgap(uint16_t reading)
+{
+  chipTemperatureSimBandgap = reading;
+}
+
+uint8_t* chipTemperatureSimEeprom()
+{
+  if (!chipTemperatureSimEepromErased) {
+    for (size_t i = 0; i < CHIPTEMP_SIM_EEPROM_SIZE; ++i) {
+      chipTemperatureSimEepromBytes[i] = 0xFF;
+    }
+    chipTemperatureSimEepromErased = true;
+  }
+  return chipTemperatureSimEepromBytes;
+}
+
+uint32_t chipTemperatureSimReadingCount()
+{
+  return chipTemperatureSimReadings;
+}
+
+// Scales the reading by the reference drift, the same as the bandgap reading shows it,
+//  and clamps it to the 10-bit ADC range
+static uint16_t chipTemperatureSimDrift(uint32_t reading)
+{
+  reading = (reading * chipTemperatureSimBandgap + CHIPTEMP_BANDGAP_NOMINAL / 2)
+              / CHIPTEMP_BANDGAP_NOMINAL;
+  return (uint16_t)((reading > 1023) ? 1023 : reading);
+}
+
+// Returns the next simulated reading, clamped to the 10-bit ADC range
+uint16_t chipTemperatureReadRaw_AVR()
+{
+  ++chipTemperatureSimReadings;
+  if (chipTemperatureSimTraceCount != 0) {
+    uint16_t reading = chipTemperatureSimTrace[chipTemperatureSimTraceIndex];
+    if (++chipTemperatureSimTraceIndex == chipTemperatureSimTraceCount) {
+      chipTemperatureSimTraceIndex = 0;
+    }
+    return chipTemperatureSimDrift(reading);
+  }
+  // xorshift32, fast and good enough for the noise
+  uint32_t x = chipTemperatureSimSeed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  chipTemperatureSimSeed = x;
+  int32_t reading = (int32_t)chipTemperatureSimReading
+                      + (int32_t)(x % (2u * chipTemperatureSimNoise + 1u))
+                      - chipTemperatureSimNoise;
+  return chipTemperatureSimDrift((uint16_t)((reading < 0) ? 0 : reading));
+}
+
+bool chipTemperatureReadRawAsync_AVR(uint16_t& reading, bool restart)
+{
+  // On the hardware, the call which collects the reading also starts the next one,
+  //  and it is not done yet by the next call, so the readings are on each 2nd call
+  // Without restart, the next call starts it instead, which is the same 2nd call
+  (void)restart;
+  chipTemperatureSimAsyncStarted = !chipTemperatureSimAsyncStarted;
+  if (chipTemperatureSimAsyncStarted) {
+    return false;
+  }
+  reading = chipTemperatureReadRaw_AVR();
+  return true;
+}
+
+uint16_t chipTemperatureReadRawSleep_AVR()
+{
+  return chipTemperatureReadRaw_AVR();
+}
+
+void chipTemperatureStartAuto_AVR(uint8_t mode)
+{
+  (void)mode;
+  chipTemperatureSimAuto = true;
+}
+
+void chipTemperatureStopAuto_AVR()
+{
+  chipTemperatureSimAuto = false;
+}
+
+// A new auto-triggered reading is there on each call
+bool chipTemperatureReadRawAuto_AVR(uint16_t& reading)
+{
+  if (!chipTemperatureSimAuto) {
+    return false;
+  }
+  reading = chipTemperatureReadRaw_AVR();
+  return true;
+}
+
+// No ring to flush, the readings are made on demand
+void chipTemperatureFlushAuto_AVR()
+{
+}
+
+void chipTemperatureReleaseMux_AVR()
+{
+}
+
+void chipTemperatureSetSpeed_AVR(uint8_t speed)
+{
+  (void)speed;
+}
+
+// There are no other channels, they all read as 0
+void chipTemperatureAnalogRead_AVR(const uint8_t* pins, uint16_t* values, uint8_t count)
+{
+  (void)pins;
+  for (uint8_t i = 0; i < count; ++i) {
+    values[i] = 0;
+  }
+}
+
+void chipTemperaturePrepareBurst_AVR()
+{
+}
+
+// Same as ATmega32U4, the reference of the sensor is not the bandgap itself
+uint16_t chipTemperatureReadBandgap_AVR()
+{
+  return chipTemperatureSimBandgap;
+}
+
+// Same 2nd call of collecting as chipTemperatureReadRawAsync_AVR()
+bool chipTemperatureReadBandgapAsync_AVR(uint16_t& reading)
+{
+  chipTemperatureSimAsyncStarted = !chipTemperatureSimAsyncStarted;
+  if (chipTemperatureSimAsyncStarted) {
+    return false;
+  }
+  reading = chipTemperatureReadBandgap_AVR();
+  return true;
+}
+
+bool chipTemperatureHasBandgap_AVR()
+{
+  return true;
+}
+
+// Out of the EEPROM size reads as erased, and is not written, same as wrapping would not be
+void chipTemperatureEepromRead_AVR(uint16_t address, uint8_t* data, uint8_t size)
+{
+  const uint8_t* eeprom = chipTemperatureSimEeprom();
+  for (uint8_t i = 0; i < size; ++i) {
+    data[i] = ((size_t)address + i < CHIPTEMP_SIM_EEPROM_SIZE) ? eeprom[address + i] : 0xFF;
+  }
+}
+
+void chipTemperatureEepromWrite_AVR(uint16_t address, const uint8_t* data, uint8_t size)
+{
+  uint8_t* eeprom = chipTemperatureSimEeprom();
+  for (uint8_t i = 0; i < size; ++i) {
+    if ((size_t)address + i < CHIPTEMP_SIM_EEPROM_SIZE) {
+      eeprom[address + i] = data[i];
+    }
+  }
+}
+
+#endif // CHIPTEMP_HW_SIM
@@ -0,0 +1,45 @@
+// ChipTemperature - host simulation of the hardware, selected by CHIPTEMP_HW_SIM
+// Included by ChipTemperature.h, not to be included directly
+// Lets the averaging, filters, calibration and conversions build and run
+//  on a desktop compiler, with the readings from a recorded trace or synthetic noise
+// Build all the library .cpp files with -DCHIPTEMP_HW_SIM, no Arduino core is needed,
+//  see extras/sim/ChipTemperatureSim.cpp
+#ifndef _CHIP_TEMPERATURE_SIM_H
+#define _CHIP_TEMPERATURE_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Flash is the same as RAM on the host
+#ifndef PROGMEM
+#define PROGMEM
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#endif
+
+// The simulated clock, used by ChipTemperatureT::setSamplePeriod()
+// Starts at 0, and only moves by chipTemperatureSimAdvanceMicros()
+unsigned long micros();
+
+// The readings are taken from the trace, from readings[0] to readings[count - 1],
+//  and then from readings[0] again
+// The array must live until the next chipTemperatureSim...() setup call
+void chipTemperatureSimSetTrace(const uint16_t* readings, size_t count);
+// The readings are reading plus the uniform noise from -noise to +noise,
+//  with the same sequence for the same seed (which must not be 0)
+// This is the default, with reading 350, noise 2, seed 1
+void chipTemperatureSimSetNoise(uint16_t reading, uint8_t noise, uint32_t seed);
+// Moves the simulated clock micros() forward
+void chipTemperatureSimAdvanceMicros(uint32_t us);
+// Sets the bandgap reading, CHIPTEMP_BANDGAP_NOMINAL by default
+// The sensor readings are scaled by reading / CHIPTEMP_BANDGAP_NOMINAL too,
+//  as the reference drift does it on the hardware
+void chipTemperatureSimSetBandgap(uint16_t reading);
+// The simulated EEPROM of ChipTempStore, same size as of ATmega32U4 and ATmega328P
+#define CHIPTEMP_SIM_EEPROM_SIZE  1024
+// Returns the simulated EEPROM bytes, to look at them, or to damage them
+uint8_t* chipTemperatureSimEeprom();
+// Returns the number of the hardware readings done since the start
+uint32_t chipTemperatureSimReadingCount();
+
+#endif // _CHIP_TEMPERATURE_SIM_H
@@ -0,0 +1,77 @@
+// ChipTemperature - hardware specifics of ATtiny85 (Digispark etc)
+// Included by ChipTemperature.h, not to be included directly
+#ifndef _CHIP_TEMPERATURE_T85_H
+#define _CHIP_TEMPERATURE_T85_H
+
+// Hardware traits for ChipTemperature_avr.cpp, see ChipTemperature_m32u4.h
+struct ChipTempHw_t85 {
+  // ADMUX value which selects the temperature sensor and its analog reference:
+  //  REFS2..0 is 0b010 -> internal 1.1V voltage for ref (REFS2 is bit 4),
+  //  ADLAR (left-adjust result) is 0,
+  //  MUX3..0 is 0b1111
+  // See select() below for the datasheet references
+  static const uint8_t ADMUX_SENSOR = _BV(REFS1) | 0x0F;
+  // No ADC High Speed Mode on this chip
+  static const uint8_t HIGH_SPEED_MASK = 0;
+  // ADTS2..0: ADC Auto Trigger Source bits of ADCSRB
+  static const uint8_t ADTS_MASK = _BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0);
+  // The reference of the sensor is the 1.1V bandgap itself, so the bandgap reads
+  //  as the full scale whatever the drift is, and tells nothing, see selectBandgap()
+  static const uint8_t ADMUX_BANDGAP = 0;
+
+  // Connects the temperature sensor as ADC input,
+  //   powers the sensor up,
+  //   and sets the proper analog reference for it
+  static inline void select() __attribute__((always_inline)) {
+    // ATtiny85 datasheet, the chapter of:
+    //  17.12 Temperature Measurement
+    // says:
+    //  "The temperature measurement is based on an on-chip temperature sensor
+    //   that is coupled to a single ended ADC4 channel.
+    //   Selecting the ADC4 channel by writing the MUX3:0 bits in ADMUX register
+    //   to "1111" enables the temperature sensor.
+    //   The internal 1.1V reference must also be selected
+    //   for the ADC reference source in the temperature sensor measurement."
+    // There is no MUX5 on this chip, ADMUX is enough
+    ADMUX = ADMUX_SENSOR;
+  }
+
+  // Never called, since ADMUX_BANDGAP is 0
+  static inline void selectBandgap() __attribute__((always_inline)) {
+  }
+
+  // Returns true if the multiplexer selects the temperature sensor, as select() does it
+  static inline bool isSelected() __attribute__((always_inline)) {
+    return ADMUX == ADMUX_SENSOR;
+  }
+
+  // Never selected, since ADMUX_BANDGAP is 0
+  static inline bool isBandgapSelected() __attribute__((always_inline)) {
+    return false;
+  }
+
+  // Provides the ADTS2..0 value and the timer interrupt flag for the auto-triggered mode
+  // Timer1 cannot trigger the ADC on this chip,
+  //  so CHIPTEMP_MODE_TIMER1 is Timer0 Compare Match B here
+  static inline void autoTrigger(uint8_t mode, uint8_t& adts,
+                                  volatile uint8_t*& flagReg, uint8_t& flag)
+                                  __attribute__((always_inline)) {
+    // The chapter of:
+    //  17.13.4 ADCSRB  ADC Control and Status Register B
+    // says for ADTS2..0:
+    //  "0 1 1 Timer/Counter0 Compare Match A"
+    //  "1 0 1 Timer/Counter0 Compare Match B"
+    flagReg = &TIFR;
+    if (mode == CHIPTEMP_MODE_TIMER1) {
+      adts = _BV(ADTS2) | _BV(ADTS0);
+      flag = _BV(OCF0B);
+    } else {
+      adts = _BV(ADTS1) | _BV(ADTS0);
+      flag = _BV(OCF0A);
+    }
+  }
+};
+
+typedef ChipTempHw_t85 ChipTempHw;
+
+#endif // _CHIP_TEMPERATURE_T85_H